@@ -33,7 +33,34 @@
 #define SCD30_POST_EPD_DELAY_MS 8000
 #define SCD30_POWER_OFF_AFTER_READ 0
 #define SCD30_RESTORE_POWER_AFTER_EPD 1
+// Draw the graph straight into controller plane order (SP6N) so the refresh
+// needs no transpose.
+#define SCD30_RENDER_NATIVE 1
 
 #define WIFI_STARTUP_DELAY_MS 10000
 
+// Leave a controller's data RAM alone when its plane did not change. The
+// per-frame panel init then skips its hardware reset, since that clears RAM.
+#ifndef EPD_SKIP_UNCHANGED_PLANES
+#define EPD_SKIP_UNCHANGED_PLANES 1
+#endif
+
+// Refresh phase histograms are written to NVS after this many refreshes.
+#define EPD_STATS_SAVE_EVERY 10
+
+// Frame-sized buffers allocated once at boot and shared by the upload handler,
+// the SCD30 renderer and the EPD worker (mailbox slot plus the frame on the
+// panel).
+#define FRAME_POOL_BUFFERS 4
+
+// POST /image/stream: ring between the HTTP receive and the plane transfer,
+// and how long the transfer waits for the next byte before giving up.
+#define EPD_STREAM_RING_BYTES 4096
+#define EPD_STREAM_TIMEOUT_MS 10000
+
+// HSK1 uploads decode in statically reserved heatshrink state: this many
+// decoders, each sized for the largest window an upload may ask for.
+#define UPLOAD_HS_DECODERS 1
+#define UPLOAD_HS_MAX_WINDOW_BITS 12
+
 #endif
@@ -1,13 +1,21 @@
 #include "epd_169inch.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "config.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
 
 #include "epd_169inch_bus.h"
+#include "epd_stats.h"
 
 #define TEMPTR_ON 0xFF
 #define TEMPTR_OFF 0x00
@@ -22,22 +30,86 @@
 #define PIC_A 0xFD
 #define STRIPE 0xFE
 
+#define EPD_PLANE_CHUNK_BYTES 4000U
+
+#define EPD_NVS_NAMESPACE "epd"
+#define EPD_NVS_KEY_CLOCK "spi_clk"
+#define EPD_NVS_KEY_OTP "otp"
+#define EPD_NVS_KEY_SHOWN "shown"
+
+#define EPD_SP6N_MAGIC 0x4E365053U
+
+#define EPD_OTP_BYTES 208U
+#define EPD_OTP_CACHE_MAGIC 0x454F5450U
+
+#define EPD_CLOCK_CAL_MAGIC 0x45434C4BU
+#define EPD_CLOCK_CAL_MAX_HZ 20000000U
+#define EPD_CLOCK_CAL_PASSES 2
+#define EPD_CLOCK_CAL_TEMPTR_TOLERANCE 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t clock_hz;
+    uint8_t vcom;
+    uint8_t pwr[5];
+    uint8_t temptr;
+    uint8_t reserved;
+    uint32_t crc;
+} epd_clock_cal_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t otp_id;
+    uint8_t vcom;
+    uint8_t pwr[5];
+    uint8_t reserved[2];
+    uint32_t crc;
+} epd_otp_cache_t;
+
+static const uint32_t s_clock_steps[] = {
+    250000, 500000, 1000000, 2000000, 4000000, 8000000, 10000000, 16000000, 20000000,
+};
+
 static const char *TAG = "epd_169";
 
 static uint8_t temptr_cur;
 static uint8_t otp_pwr[5];
 static bool epd_ready;
+#if EPD_SKIP_UNCHANGED_PLANES
+static uint8_t s_plane_chunk[EPD_PLANE_CHUNK_BYTES];
+#endif
+static epd_clock_cal_t s_clock_cal;
+static epd_otp_cache_t s_otp;
+static bool s_otp_valid;
+static uint32_t s_shown_crc;
+static bool s_shown_valid;
+#if EPD_SKIP_UNCHANGED_PLANES
+// What each controller's data RAM holds, as a CRC32 of the frame masked to
+// that controller's nibble (sp6) or of the plane itself (native, seeded with
+// the SP6N magic so the two never compare equal); index 0 is master, 1 is slave.
+static uint32_t s_plane_crc[2];
+static bool s_plane_valid[2];
+#endif
+static bool s_nvs_ready;
+
+static void record_phase(epd_phase_t phase, int64_t start_us)
+{
+    epd_stats_record(phase, (uint32_t)(esp_timer_get_time() - start_us));
+}
 
 static uint8_t read_temptr(void)
 {
     uint8_t temptr_intgr;
+    int64_t start_us = esp_timer_get_time();
 
     epd_bus_write_cmd(EPD_MASTER_ONLY, 0x40);
     epd_bus_delay_ms(100);
-    epd_bus_wait_busy();
+    epd_bus_wait_busy(EPD_CMD_TEMPTR);
     temptr_intgr = epd_bus_read_data(EPD_MASTER_ONLY);
     (void)epd_bus_read_data(EPD_MASTER_ONLY);
 
+    record_phase(EPD_PHASE_TEMPERATURE, start_us);
+    epd_stats_set_temperature((int8_t)temptr_intgr);
     temptr_cur = temptr_intgr;
     return temptr_intgr;
 }
@@ -49,13 +121,13 @@ static void write_temptr(uint8_t temptr_lock)
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0xE5);
     epd_bus_write_data(EPD_MASTER_SLAVE, temptr_lock);
-    epd_bus_wait_busy();
+    epd_bus_wait_busy(0xE5);
 }
 
-static void read_otp_pwr(uint8_t temptr_opt)
+static void read_otp_values(uint8_t temptr_opt, epd_otp_cache_t *out)
 {
-    uint8_t otp_vcom;
     uint8_t temptr_val;
+    uint8_t otp[EPD_OTP_BYTES];
 
     epd_bus_set_master_mode(true);
     epd_bus_reset();
@@ -86,12 +158,12 @@ static void read_otp_pwr(uint8_t temptr_opt)
     write_temptr(temptr_val);
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x04);
-    epd_bus_wait_busy();
+    epd_bus_wait_busy(EPD_CMD_POWER_ON);
     epd_bus_delay_ms(10);
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x02);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x00);
-    epd_bus_wait_busy();
+    epd_bus_wait_busy(EPD_CMD_POWER_OFF);
     epd_bus_delay_ms(10);
 
     epd_bus_set_master_mode(false);
@@ -100,11 +172,13 @@ static void read_otp_pwr(uint8_t temptr_opt)
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0xF0);
     (void)epd_bus_read_data(EPD_MASTER_ONLY);
 
-    for (uint16_t j = 0; j < 207; j++) {
-        (void)epd_bus_read_data(EPD_MASTER_ONLY);
+    for (uint16_t j = 0; j < EPD_OTP_BYTES; j++) {
+        otp[j] = epd_bus_read_data(EPD_MASTER_ONLY);
     }
 
-    otp_vcom = epd_bus_read_data(EPD_MASTER_ONLY);
+    // VCOM is the last byte of the block; the CRC of the whole block tells panels apart.
+    out->vcom = otp[EPD_OTP_BYTES - 1U];
+    out->otp_id = esp_rom_crc32_le(0, otp, sizeof(otp));
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0xF5);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0xA5);
@@ -113,15 +187,24 @@ static void read_otp_pwr(uint8_t temptr_opt)
     (void)epd_bus_read_data(EPD_MASTER_ONLY);
 
     for (uint8_t i = 0; i < 5; i++) {
-        otp_pwr[i] = epd_bus_read_data(EPD_MASTER_ONLY);
+        out->pwr[i] = epd_bus_read_data(EPD_MASTER_ONLY);
     }
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0xF5);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x00);
+}
 
-    epd_bus_set_master_mode(true);
-    epd_bus_reset();
-    epd_bus_set_master_mode(false);
+// A hardware reset clears the controllers' data RAM, so it is left out when a
+// plane already in RAM is kept; the register writes below apply either way.
+static void write_panel_init(uint8_t otp_vcom, bool reset)
+{
+    if (reset) {
+        int64_t start_us = esp_timer_get_time();
+        epd_bus_set_master_mode(true);
+        epd_bus_reset();
+        epd_bus_set_master_mode(false);
+        record_phase(EPD_PHASE_RESET, start_us);
+    }
 
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x66);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x49);
@@ -171,195 +254,627 @@ static void read_otp_pwr(uint8_t temptr_opt)
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x01);
 }
 
+static bool otp_matches_reference(const epd_otp_cache_t *otp)
+{
+    return otp->vcom == s_clock_cal.vcom &&
+           memcmp(otp->pwr, s_clock_cal.pwr, sizeof(s_clock_cal.pwr)) == 0;
+}
+
+static bool otp_equal(const epd_otp_cache_t *a, const epd_otp_cache_t *b)
+{
+    return a->otp_id == b->otp_id && a->vcom == b->vcom &&
+           memcmp(a->pwr, b->pwr, sizeof(a->pwr)) == 0;
+}
+
+static bool clock_verify(uint32_t hz)
+{
+    epd_otp_cache_t otp;
+
+    epd_bus_set_clock_hz(hz);
+    for (int pass = 0; pass < EPD_CLOCK_CAL_PASSES; pass++) {
+        read_otp_values(TEMPTR_ON, &otp);
+        int temptr_delta = (int)temptr_cur - (int)s_clock_cal.temptr;
+        if (!otp_matches_reference(&otp) ||
+            temptr_delta > EPD_CLOCK_CAL_TEMPTR_TOLERANCE ||
+            temptr_delta < -EPD_CLOCK_CAL_TEMPTR_TOLERANCE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t clock_cal_checksum(const epd_clock_cal_t *cal)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)cal, offsetof(epd_clock_cal_t, crc));
+}
+
+static bool ensure_nvs_ready(void)
+{
+    if (s_nvs_ready) {
+        return true;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_OK) {
+        s_nvs_ready = true;
+        return true;
+    }
+
+    ESP_LOGW(TAG, "NVS init failed: %s", esp_err_to_name(err));
+    return false;
+}
+
+static bool nvs_load_blob(const char *key, void *out, size_t size)
+{
+    if (!ensure_nvs_ready()) {
+        return false;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(EPD_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t len = size;
+    esp_err_t err = nvs_get_blob(handle, key, out, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len == size;
+}
+
+static void nvs_save_blob(const char *key, const void *data, size_t size)
+{
+    if (!ensure_nvs_ready()) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(EPD_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "NVS open failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = nvs_set_blob(handle, key, data, size);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "NVS save of %s failed: %s", key, esp_err_to_name(err));
+    }
+    nvs_close(handle);
+}
+
+static void nvs_erase(const char *key)
+{
+    if (!ensure_nvs_ready()) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(EPD_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_erase_key(handle, key) == ESP_OK) {
+        (void)nvs_commit(handle);
+    }
+    nvs_close(handle);
+}
+
+static bool clock_cal_load(void)
+{
+    epd_clock_cal_t cal = {0};
+    if (!nvs_load_blob(EPD_NVS_KEY_CLOCK, &cal, sizeof(cal))) {
+        return false;
+    }
+
+    if (cal.magic != EPD_CLOCK_CAL_MAGIC || cal.crc != clock_cal_checksum(&cal) ||
+        cal.clock_hz < epd_bus_get_default_clock_hz() || cal.clock_hz > EPD_CLOCK_CAL_MAX_HZ) {
+        ESP_LOGW(TAG, "Stored SPI clock calibration failed checksum");
+        return false;
+    }
+
+    s_clock_cal = cal;
+    return true;
+}
+
+static void clock_cal_save(void)
+{
+    s_clock_cal.magic = EPD_CLOCK_CAL_MAGIC;
+    s_clock_cal.crc = clock_cal_checksum(&s_clock_cal);
+    nvs_save_blob(EPD_NVS_KEY_CLOCK, &s_clock_cal, sizeof(s_clock_cal));
+}
+
+static void clock_calibrate(void)
+{
+    uint32_t base_hz = epd_bus_get_default_clock_hz();
+    size_t passed = 0;
+    epd_otp_cache_t otp;
+
+    ESP_LOGI(TAG, "Calibrating SPI clock");
+    epd_bus_set_clock_hz(base_hz);
+    read_otp_values(TEMPTR_ON, &otp);
+    s_clock_cal.vcom = otp.vcom;
+    memcpy(s_clock_cal.pwr, otp.pwr, sizeof(s_clock_cal.pwr));
+    s_clock_cal.temptr = temptr_cur;
+
+    for (size_t i = 1; i < sizeof(s_clock_steps) / sizeof(s_clock_steps[0]); i++) {
+        if (!clock_verify(s_clock_steps[i])) {
+            ESP_LOGI(TAG, "Readback failed at %u Hz", (unsigned)s_clock_steps[i]);
+            break;
+        }
+        passed = i;
+    }
+
+    // Keep one step of headroom below the fastest clock that read back cleanly.
+    size_t chosen = passed > 0 ? passed - 1 : 0;
+    s_clock_cal.clock_hz = s_clock_steps[chosen] > base_hz ? s_clock_steps[chosen] : base_hz;
+    epd_bus_set_clock_hz(s_clock_cal.clock_hz);
+    clock_cal_save();
+    ESP_LOGI(TAG, "SPI clock calibrated to %u Hz", (unsigned)s_clock_cal.clock_hz);
+}
+
+static void clock_setup(void)
+{
+    if (clock_cal_load()) {
+        epd_bus_set_clock_hz(s_clock_cal.clock_hz);
+        ESP_LOGI(TAG, "Using stored SPI clock %u Hz", (unsigned)s_clock_cal.clock_hz);
+        return;
+    }
+    clock_calibrate();
+}
+
+static void read_otp_checked(uint8_t temptr_opt, epd_otp_cache_t *otp)
+{
+    read_otp_values(temptr_opt, otp);
+    if (s_clock_cal.magic == EPD_CLOCK_CAL_MAGIC && !otp_matches_reference(otp)) {
+        ESP_LOGW(TAG, "OTP readback mismatch at %u Hz, recalibrating",
+                 (unsigned)epd_bus_get_clock_hz());
+        clock_calibrate();
+        read_otp_values(temptr_opt, otp);
+    }
+}
+
+static uint32_t otp_cache_checksum(const epd_otp_cache_t *otp)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)otp, offsetof(epd_otp_cache_t, crc));
+}
+
+static bool otp_cache_load(epd_otp_cache_t *otp)
+{
+    if (!nvs_load_blob(EPD_NVS_KEY_OTP, otp, sizeof(*otp))) {
+        return false;
+    }
+    return otp->magic == EPD_OTP_CACHE_MAGIC && otp->crc == otp_cache_checksum(otp);
+}
+
+static void otp_cache_save(epd_otp_cache_t *otp)
+{
+    otp->magic = EPD_OTP_CACHE_MAGIC;
+    memset(otp->reserved, 0, sizeof(otp->reserved));
+    otp->crc = otp_cache_checksum(otp);
+    nvs_save_blob(EPD_NVS_KEY_OTP, otp, sizeof(*otp));
+}
+
+static void otp_setup(void)
+{
+    epd_otp_cache_t stored = {0};
+    epd_otp_cache_t again = {0};
+    bool have_stored = otp_cache_load(&stored);
+
+    s_otp_valid = false;
+    read_otp_checked(TEMPTR_ON, &s_otp);
+    if (have_stored && otp_equal(&stored, &s_otp)) {
+        s_otp = stored;
+        s_otp_valid = true;
+        ESP_LOGI(TAG, "OTP matches cache for panel %08X", (unsigned)s_otp.otp_id);
+        return;
+    }
+
+    // New panel or a changed record: only trust values that read back the same twice.
+    read_otp_checked(TEMPTR_ON, &again);
+    if (!otp_equal(&again, &s_otp)) {
+        ESP_LOGW(TAG, "OTP readback unstable, reading it on every refresh");
+        return;
+    }
+
+    otp_cache_save(&s_otp);
+    s_otp_valid = true;
+    ESP_LOGI(TAG, "Cached OTP for panel %08X (VCOM 0x%02X)", (unsigned)s_otp.otp_id, s_otp.vcom);
+}
+
+static void panel_init(bool reset)
+{
+    epd_otp_cache_t otp;
+
+    // The OTP values are factory constants, so once they are cached the
+    // reset/power cycle needed to read them is skipped.
+    if (!s_otp_valid) {
+        int64_t start_us = esp_timer_get_time();
+        read_otp_checked(TEMPTR_ON, &otp);
+        record_phase(EPD_PHASE_OTP_READ, start_us);
+        memcpy(otp_pwr, otp.pwr, sizeof(otp_pwr));
+        write_panel_init(otp.vcom, true);
+        return;
+    }
+
+    memcpy(otp_pwr, s_otp.pwr, sizeof(otp_pwr));
+    write_panel_init(s_otp.vcom, reset);
+}
+
+static void plane_forget(void)
+{
+#if EPD_SKIP_UNCHANGED_PLANES
+    s_plane_valid[0] = false;
+    s_plane_valid[1] = false;
+#endif
+}
+
 static void enter_deepsleep(void)
 {
+    plane_forget();
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x07);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0xA5);
     ESP_LOGI(TAG, "Entered deep sleep");
 }
 
-static void send_hv_stripe_data(void)
+static void write_plane_psr(epd_ms_target_t target)
 {
-    uint32_t yield_counter = 0;
-
-    ESP_LOGI(TAG, "Sending stripe data to MASTER");
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x00);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0x13);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0xE9);
+    if (target != EPD_SLAVE_ONLY) {
+        epd_bus_write_cmd(EPD_MASTER_ONLY, 0x00);
+        epd_bus_write_data(EPD_MASTER_ONLY, 0x13);
+        epd_bus_write_data(EPD_MASTER_ONLY, 0xE9);
+    }
+    if (target != EPD_MASTER_ONLY) {
+        epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x00);
+        epd_bus_write_data(EPD_SLAVE_ONLY, 0x17);
+        epd_bus_write_data(EPD_SLAVE_ONLY, 0xE9);
+    }
+}
 
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x10);
+static void begin_plane(epd_ms_target_t target)
+{
+    write_plane_psr(target);
+    epd_bus_write_cmd(target, 0x10);
     epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            if (col >= 82 && col < 200 && row >= 10 && row <= 36) {
-                epd_bus_write_data(EPD_MASTER_ONLY, WHITE);
-            } else if (col >= 82 && col < 200 && row > 36 && row <= 62) {
-                epd_bus_write_data(EPD_MASTER_ONLY, YELLOW);
-            } else if (col >= 82 && col < 200 && row > 62 && row <= 89) {
-                epd_bus_write_data(EPD_MASTER_ONLY, GREEN);
-            } else if (col >= 200 && col < 318 && row >= 10 && row <= 36) {
-                epd_bus_write_data(EPD_MASTER_ONLY, BLACK);
-            } else if (col >= 200 && col < 318 && row > 36 && row <= 62) {
-                epd_bus_write_data(EPD_MASTER_ONLY, BLUE);
-            } else if (col >= 200 && col < 318 && row > 62 && row <= 89) {
-                epd_bus_write_data(EPD_MASTER_ONLY, RED);
-            } else {
-                epd_bus_write_data(EPD_MASTER_ONLY, WHITE);
-            }
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+}
+
+static bool send_plane_source(epd_ms_target_t target, unsigned plane,
+                              epd_plane_source_t source, void *ctx)
+{
+    bool ok = true;
+
+    begin_plane(target);
+    epd_bus_stream_begin(target);
+    for (uint32_t offset = 0; offset < EPD_PLANE_BYTES;) {
+        size_t capacity = 0;
+        uint8_t *chunk = epd_bus_stream_acquire(&capacity);
+        size_t n = EPD_PLANE_BYTES - offset;
+        if (!chunk) {
+            ok = false;
+            break;
+        }
+        n = n < capacity ? n : capacity;
+        if (!source(ctx, plane, offset, chunk, n)) {
+            ok = false;
+            break;
         }
+        epd_bus_stream_commit(n);
+        offset += (uint32_t)n;
     }
+    epd_bus_stream_end();
+    return ok;
+}
+
+static void send_fill_plane(epd_ms_target_t target, uint8_t value)
+{
+    begin_plane(target);
+    epd_bus_stream_begin(target);
+    epd_bus_stream_fill(value, EPD_PLANE_BYTES);
+    epd_bus_stream_end();
+}
 
-    ESP_LOGI(TAG, "Sending stripe data to SLAVE");
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x00);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0x17);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0xE9);
+#define EPD_PLANE_ROWS 100U
 
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x10);
-    epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            if (col >= 82 && col < 200 && row >= 10 && row <= 36) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, WHITE);
-            } else if (col >= 82 && col < 200 && row > 36 && row <= 62) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, YELLOW);
-            } else if (col >= 82 && col < 200 && row > 62 && row <= 89) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, GREEN);
-            } else if (col >= 200 && col < 318 && row >= 10 && row <= 36) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, BLACK);
-            } else if (col >= 200 && col < 318 && row > 36 && row <= 62) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, BLUE);
-            } else if (col >= 200 && col < 318 && row > 62 && row <= 89) {
-                epd_bus_write_data(EPD_SLAVE_ONLY, RED);
-            } else {
-                epd_bus_write_data(EPD_SLAVE_ONLY, WHITE);
-            }
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+// The colour bars only depend on the column band, so each column is a copy
+// of one of three prebuilt 100-byte columns.
+static const uint8_t *stripe_column(uint32_t col)
+{
+    static uint8_t columns[3][EPD_PLANE_ROWS];
+    static bool built;
+
+    if (!built) {
+        static const uint8_t bands[2][3] = {{WHITE, YELLOW, GREEN}, {BLACK, BLUE, RED}};
+        memset(columns, WHITE, sizeof(columns));
+        for (int c = 0; c < 2; c++) {
+            memset(&columns[c + 1][10], bands[c][0], 27);
+            memset(&columns[c + 1][37], bands[c][1], 26);
+            memset(&columns[c + 1][63], bands[c][2], 27);
         }
+        built = true;
     }
 
-    ESP_LOGI(TAG, "Stripe data sent");
+    if (col >= 82 && col < 200) {
+        return columns[1];
+    } else if (col >= 200 && col < 318) {
+        return columns[2];
+    }
+    return columns[0];
 }
 
-static void send_hv_stripe_image_data(const uint8_t *pic)
+static bool stripe_source(void *ctx, unsigned plane, uint32_t offset, uint8_t *out, size_t len)
+{
+    (void)ctx;
+    (void)plane;
+
+    while (len > 0) {
+        uint32_t row = offset % EPD_PLANE_ROWS;
+        size_t n = EPD_PLANE_ROWS - row;
+        n = n < len ? n : len;
+        memcpy(out, &stripe_column(offset / EPD_PLANE_ROWS)[row], n);
+        out += n;
+        offset += (uint32_t)n;
+        len -= n;
+    }
+    return true;
+}
+
+static void send_hv_stripe_data(void)
 {
-    uint32_t yield_counter = 0;
+    // Both controllers get the same pattern, so it goes out once with both CS low.
+    ESP_LOGI(TAG, "Sending stripe data to MASTER and SLAVE");
+    plane_forget();
+    send_plane_source(EPD_MASTER_SLAVE, 0, stripe_source, NULL);
+    ESP_LOGI(TAG, "Stripe data sent");
+}
 
-    ESP_LOGI(TAG, "Sending image data to MASTER (rows 0-99)");
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x00);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0x13);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0xE9);
+// Plane byte j merges sp6 bytes 2j and 2j+1: their high nibbles for master,
+// their low nibbles for slave.
+static bool sp6_source(void *ctx, unsigned plane, uint32_t offset, uint8_t *out, size_t len)
+{
+    const uint8_t *src = (const uint8_t *)ctx + ((size_t)offset * 2U);
 
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x10);
-    epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            uint32_t index = (col * 200U) + (row * 2U);
-            uint8_t temp1 = (uint8_t)(pic[index] & 0xF0);
-            uint8_t temp2 = (uint8_t)(pic[index + 1] >> 4);
-            uint8_t temp = (uint8_t)(temp1 | temp2);
-            epd_bus_write_data(EPD_MASTER_ONLY, temp);
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+    if (plane == 0) {
+        for (size_t i = 0; i < len; i++) {
+            out[i] = (uint8_t)((src[i * 2U] & 0xF0) | (src[(i * 2U) + 1U] >> 4));
+        }
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            out[i] = (uint8_t)(((src[i * 2U] & 0x0F) << 4) | (src[(i * 2U) + 1U] & 0x0F));
         }
     }
+    return true;
+}
 
-    ESP_LOGI(TAG, "Sending image data to SLAVE (rows 100-199)");
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x00);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0x17);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0xE9);
+static void send_image_plane(epd_ms_target_t target, const uint8_t *pic, bool high_nibbles)
+{
+    send_plane_source(target, high_nibbles ? 0U : 1U, sp6_source, (void *)pic);
+}
 
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x10);
-    epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            uint32_t index = (col * 200U) + (row * 2U);
-            uint8_t temp1 = (uint8_t)((pic[index] & 0x0F) << 4);
-            uint8_t temp2 = (uint8_t)(pic[index + 1] & 0x0F);
-            uint8_t temp = (uint8_t)(temp1 | temp2);
-            epd_bus_write_data(EPD_SLAVE_ONLY, temp);
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+typedef struct {
+    bool planes_equal;
+    bool master_uniform;
+    bool slave_uniform;
+    uint8_t master_value;
+    uint8_t slave_value;
+} epd_image_layout_t;
+
+static void analyse_image(const uint8_t *pic, size_t length, epd_image_layout_t *out)
+{
+    uint8_t first = pic[0];
+    uint8_t diff = 0;
+    uint8_t nibble_mismatch = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t b = pic[i];
+        diff |= (uint8_t)(b ^ first);
+        nibble_mismatch |= (uint8_t)((b >> 4) ^ (b & 0x0F));
+    }
+
+    // Master takes the high nibbles and slave the low ones, so a plane is a
+    // solid fill when that nibble never changes across the frame.
+    out->planes_equal = nibble_mismatch == 0;
+    out->master_uniform = (diff & 0xF0) == 0;
+    out->slave_uniform = (diff & 0x0F) == 0;
+    out->master_value = (uint8_t)((first & 0xF0) | (first >> 4));
+    out->slave_value = (uint8_t)(((first & 0x0F) << 4) | (first & 0x0F));
+}
+
+static void send_native_plane(epd_ms_target_t target, const uint8_t *plane)
+{
+    // Already in controller order: hand the bytes to the bus as they are.
+    begin_plane(target);
+    epd_bus_stream_begin(target);
+    epd_bus_stream_write_inplace(plane, EPD_PLANE_BYTES);
+    epd_bus_stream_end();
+}
+
+#if EPD_SKIP_UNCHANGED_PLANES
+static void plane_digests(const uint8_t *pic, uint32_t *master_crc, uint32_t *slave_crc)
+{
+    uint8_t *chunk = s_plane_chunk;
+    uint32_t m = 0;
+    uint32_t sl = 0;
+
+    // Hashing the masked frame identifies a plane as well as hashing the
+    // transposed bytes, without building the plane first.
+    for (size_t off = 0; off < EPD_FRAME_BYTES; off += EPD_PLANE_CHUNK_BYTES) {
+        for (size_t i = 0; i < EPD_PLANE_CHUNK_BYTES; i++) {
+            chunk[i] = pic[off + i] & 0xF0;
+        }
+        m = esp_rom_crc32_le(m, chunk, EPD_PLANE_CHUNK_BYTES);
+        for (size_t i = 0; i < EPD_PLANE_CHUNK_BYTES; i++) {
+            chunk[i] = pic[off + i] & 0x0F;
         }
+        sl = esp_rom_crc32_le(sl, chunk, EPD_PLANE_CHUNK_BYTES);
     }
+    *master_crc = m;
+    *slave_crc = sl;
+}
 
-    ESP_LOGI(TAG, "Image data sent");
+// Works out which planes differ from the controllers' RAM and remembers the
+// new ones; the caller forgets them again until their transfer completes.
+static void plane_check(const uint8_t *frame, epd_frame_format_t format, bool dirty[2])
+{
+    uint32_t crc[2];
+
+    // Reading the OTP resets the controllers, which loses their RAM.
+    if (!s_otp_valid) {
+        plane_forget();
+    }
+    if (format == EPD_FRAME_NATIVE) {
+        crc[0] = esp_rom_crc32_le(EPD_SP6N_MAGIC, frame, EPD_PLANE_BYTES);
+        crc[1] = esp_rom_crc32_le(EPD_SP6N_MAGIC, &frame[EPD_PLANE_BYTES], EPD_PLANE_BYTES);
+    } else {
+        plane_digests(frame, &crc[0], &crc[1]);
+    }
+    for (int i = 0; i < 2; i++) {
+        dirty[i] = !s_plane_valid[i] || s_plane_crc[i] != crc[i];
+        s_plane_crc[i] = crc[i];
+    }
 }
 
-static void send_hv_stripe_clean_data(void)
+static void plane_remember(void)
 {
-    uint32_t yield_counter = 0;
+    s_plane_valid[0] = true;
+    s_plane_valid[1] = true;
+}
+#else
+static void plane_remember(void)
+{
+}
+#endif
 
-    ESP_LOGI(TAG, "Sending full white data to MASTER");
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x00);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0x13);
-    epd_bus_write_data(EPD_MASTER_ONLY, 0xE9);
+static void send_one_plane(epd_ms_target_t target, const uint8_t *pic, bool uniform,
+                           uint8_t value, bool dirty)
+{
+    const char *name = target == EPD_MASTER_ONLY ? "MASTER" : "SLAVE";
+
+    if (!dirty) {
+        ESP_LOGI(TAG, "%s plane unchanged, keeping controller RAM", name);
+        write_plane_psr(target);
+    } else if (uniform) {
+        ESP_LOGI(TAG, "Filling %s with 0x%02X", name, value);
+        send_fill_plane(target, value);
+    } else {
+        ESP_LOGI(TAG, "Sending image data to %s", name);
+        send_image_plane(target, pic, target == EPD_MASTER_ONLY);
+    }
+}
 
-    epd_bus_write_cmd(EPD_MASTER_ONLY, 0x10);
-    epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            epd_bus_write_data(EPD_MASTER_ONLY, WHITE);
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+static void send_hv_stripe_image_data(const uint8_t *pic, const bool dirty[2])
+{
+    epd_image_layout_t layout;
+    bool master_dirty = dirty[0];
+    bool slave_dirty = dirty[1];
+
+    analyse_image(pic, EPD_FRAME_BYTES, &layout);
+
+    // A plane is only known after its transfer completes.
+    plane_forget();
+    int64_t start_us = esp_timer_get_time();
+    if (layout.planes_equal && master_dirty && slave_dirty) {
+        if (layout.master_uniform) {
+            ESP_LOGI(TAG, "Filling MASTER and SLAVE with 0x%02X", layout.master_value);
+            send_fill_plane(EPD_MASTER_SLAVE, layout.master_value);
+        } else {
+            ESP_LOGI(TAG, "Sending identical image planes to MASTER and SLAVE");
+            send_image_plane(EPD_MASTER_SLAVE, pic, true);
         }
+        // One broadcast fills both; it counts as the master transfer only, so
+        // slave_xfer holds real slave transfers.
+        record_phase(EPD_PHASE_MASTER_XFER, start_us);
+    } else {
+        send_one_plane(EPD_MASTER_ONLY, pic, layout.master_uniform, layout.master_value,
+                       master_dirty);
+        record_phase(EPD_PHASE_MASTER_XFER, start_us);
+        start_us = esp_timer_get_time();
+        send_one_plane(EPD_SLAVE_ONLY, pic, layout.slave_uniform, layout.slave_value,
+                       slave_dirty);
+        record_phase(EPD_PHASE_SLAVE_XFER, start_us);
     }
 
-    ESP_LOGI(TAG, "Sending full white data to SLAVE");
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x00);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0x17);
-    epd_bus_write_data(EPD_SLAVE_ONLY, 0xE9);
+    plane_remember();
+    ESP_LOGI(TAG, "Image data sent");
+}
 
-    epd_bus_write_cmd(EPD_SLAVE_ONLY, 0x10);
-    epd_bus_delay_ms(10);
-    for (uint16_t col = 0; col < 400; col++) {
-        for (uint16_t row = 0; row < 100; row++) {
-            epd_bus_write_data(EPD_SLAVE_ONLY, WHITE);
-            yield_counter++;
-            if ((yield_counter % 2000U) == 0U) {
-                vTaskDelay(1);
-            }
+static void send_native_image_data(const uint8_t *planes, const bool dirty[2])
+{
+    const uint8_t *master = planes;
+    const uint8_t *slave = &planes[EPD_PLANE_BYTES];
+    bool master_dirty = dirty[0];
+    bool slave_dirty = dirty[1];
+
+    plane_forget();
+    int64_t start_us = esp_timer_get_time();
+    if (master_dirty && slave_dirty && memcmp(master, slave, EPD_PLANE_BYTES) == 0) {
+        ESP_LOGI(TAG, "Sending identical native planes to MASTER and SLAVE");
+        send_native_plane(EPD_MASTER_SLAVE, master);
+        record_phase(EPD_PHASE_MASTER_XFER, start_us);
+    } else {
+        if (master_dirty) {
+            ESP_LOGI(TAG, "Sending native plane to MASTER");
+            send_native_plane(EPD_MASTER_ONLY, master);
+        } else {
+            ESP_LOGI(TAG, "MASTER plane unchanged, keeping controller RAM");
+            write_plane_psr(EPD_MASTER_ONLY);
+        }
+        record_phase(EPD_PHASE_MASTER_XFER, start_us);
+        start_us = esp_timer_get_time();
+        if (slave_dirty) {
+            ESP_LOGI(TAG, "Sending native plane to SLAVE");
+            send_native_plane(EPD_SLAVE_ONLY, slave);
+        } else {
+            ESP_LOGI(TAG, "SLAVE plane unchanged, keeping controller RAM");
+            write_plane_psr(EPD_SLAVE_ONLY);
         }
+        record_phase(EPD_PHASE_SLAVE_XFER, start_us);
     }
 
+    plane_remember();
+    ESP_LOGI(TAG, "Image data sent");
+}
+
+static void send_hv_stripe_clean_data(void)
+{
+    ESP_LOGI(TAG, "Sending full white data to MASTER and SLAVE");
+    send_fill_plane(EPD_MASTER_SLAVE, WHITE);
     ESP_LOGI(TAG, "Full white data sent");
 }
 
 static void epd_display(uint8_t display_bkg)
 {
+    uint32_t power_on_ms;
+    uint32_t refresh_ms;
+    uint32_t power_off_ms;
+
     ESP_LOGI(TAG, "Starting EPD display");
     if (display_bkg == STRIPE) {
         send_hv_stripe_data();
     }
 
     ESP_LOGI(TAG, "Sending power on command");
+    int64_t start_us = esp_timer_get_time();
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x04);
-    epd_bus_wait_busy();
+    power_on_ms = epd_bus_wait_busy(EPD_CMD_POWER_ON);
+    record_phase(EPD_PHASE_POWER_ON, start_us);
 
     ESP_LOGI(TAG, "Sending refresh command");
+    start_us = esp_timer_get_time();
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x12);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x00);
     epd_bus_delay_ms(10);
-    epd_bus_wait_busy();
+    refresh_ms = epd_bus_wait_busy(EPD_CMD_REFRESH);
+    record_phase(EPD_PHASE_REFRESH, start_us);
 
     ESP_LOGI(TAG, "Sending power off command");
+    start_us = esp_timer_get_time();
     epd_bus_write_cmd(EPD_MASTER_SLAVE, 0x02);
     epd_bus_write_data(EPD_MASTER_SLAVE, 0x00);
-    epd_bus_wait_busy();
+    power_off_ms = epd_bus_wait_busy(EPD_CMD_POWER_OFF);
+    record_phase(EPD_PHASE_POWER_OFF, start_us);
     epd_bus_delay_ms(20);
-    ESP_LOGI(TAG, "EPD display completed");
+    ESP_LOGI(TAG, "EPD display completed (power on %u ms, refresh %u ms, power off %u ms)",
+             (unsigned)power_on_ms, (unsigned)refresh_ms, (unsigned)power_off_ms);
 }
 
 void epd_setup(void)
@@ -368,28 +883,165 @@ void epd_setup(void)
         return;
     }
 
+    epd_stats_init();
     epd_bus_init();
     epd_bus_reset();
-    epd_bus_wait_busy();
+    epd_bus_wait_busy(EPD_CMD_NONE);
+    clock_setup();
+    otp_setup();
     epd_ready = true;
 }
 
-void epd_show_image(const uint8_t *image_data, size_t length)
+static uint32_t frame_crc(const uint8_t *frame, epd_frame_format_t format)
+{
+    // The same bytes mean a different picture in the other layout.
+    uint32_t seed = format == EPD_FRAME_NATIVE ? EPD_SP6N_MAGIC : 0U;
+    return esp_rom_crc32_le(seed, frame, EPD_FRAME_BYTES);
+}
+
+static void shown_save(uint32_t crc)
+{
+    s_shown_crc = crc;
+    s_shown_valid = true;
+    nvs_save_blob(EPD_NVS_KEY_SHOWN, &crc, sizeof(crc));
+}
+
+static void shown_forget(void)
+{
+    s_shown_valid = false;
+    nvs_erase(EPD_NVS_KEY_SHOWN);
+}
+
+bool epd_native_header_valid(const uint8_t *header)
+{
+    uint32_t magic = (uint32_t)header[0] | ((uint32_t)header[1] << 8) |
+                     ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24);
+    uint32_t size = (uint32_t)header[4] | ((uint32_t)header[5] << 8) |
+                    ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+    return magic == EPD_SP6N_MAGIC && size == EPD_FRAME_BYTES;
+}
+
+bool epd_parse_frame(const uint8_t *data, size_t length, const uint8_t **frame,
+                     epd_frame_format_t *format)
 {
-    const size_t expected = 400U * 400U / 2U;
-    if (!image_data || length != expected) {
+    if (!data) {
+        return false;
+    }
+    if (length == EPD_FRAME_BYTES) {
+        *frame = data;
+        *format = EPD_FRAME_SP6;
+        return true;
+    }
+    if (length != EPD_SP6N_HEADER_BYTES + EPD_FRAME_BYTES) {
+        return false;
+    }
+
+    if (!epd_native_header_valid(data)) {
+        return false;
+    }
+    *frame = &data[EPD_SP6N_HEADER_BYTES];
+    *format = EPD_FRAME_NATIVE;
+    return true;
+}
+
+bool epd_frame_unchanged(const uint8_t *frame, size_t length, epd_frame_format_t format)
+{
+    if (!frame || length != EPD_FRAME_BYTES || !s_shown_valid) {
+        return false;
+    }
+    return frame_crc(frame, format) == s_shown_crc;
+}
+
+bool epd_restore_displayed_frame(const uint8_t *frame, size_t length, epd_frame_format_t format)
+{
+    uint32_t saved = 0;
+
+    if (!frame || length != EPD_FRAME_BYTES ||
+        !nvs_load_blob(EPD_NVS_KEY_SHOWN, &saved, sizeof(saved))) {
+        return false;
+    }
+
+    // The stored file may be newer than the last refresh (e.g. the refresh was
+    // skipped), so only trust it when it hashes to what was really shown.
+    uint32_t crc = frame_crc(frame, format);
+    if (crc != saved) {
+        ESP_LOGI(TAG, "Stored frame %08X is not the displayed one", (unsigned)crc);
+        return false;
+    }
+    s_shown_crc = crc;
+    s_shown_valid = true;
+    ESP_LOGI(TAG, "Restored displayed frame hash %08X", (unsigned)crc);
+    return true;
+}
+
+epd_show_result_t epd_show_frame(const uint8_t *frame, size_t length, epd_frame_format_t format)
+{
+    if (!frame || length != EPD_FRAME_BYTES) {
         ESP_LOGE(TAG, "Invalid image data length: %u (expected %u)",
-                 (unsigned)length, (unsigned)expected);
-        return;
+                 (unsigned)length, (unsigned)EPD_FRAME_BYTES);
+        return EPD_SHOW_INVALID;
+    }
+
+    uint32_t crc = frame_crc(frame, format);
+    if (s_shown_valid && crc == s_shown_crc) {
+        ESP_LOGI(TAG, "Frame %08X already displayed, skipping refresh", (unsigned)crc);
+        return EPD_SHOW_UNCHANGED;
     }
 
     if (!epd_ready) {
         epd_setup();
     }
 
-    read_otp_pwr(TEMPTR_ON);
-    send_hv_stripe_image_data(image_data);
+    bool dirty[2] = {true, true};
+#if EPD_SKIP_UNCHANGED_PLANES
+    plane_check(frame, format, dirty);
+#endif
+    panel_init(dirty[0] && dirty[1]);
+    if (format == EPD_FRAME_NATIVE) {
+        send_native_image_data(frame, dirty);
+    } else {
+        send_hv_stripe_image_data(frame, dirty);
+    }
     epd_display(PIC_A);
+    shown_save(crc);
+    epd_stats_frame_done();
+    return EPD_SHOW_OK;
+}
+
+epd_show_result_t epd_show_source(epd_plane_source_t source, void *ctx)
+{
+    if (!source) {
+        return EPD_SHOW_INVALID;
+    }
+
+    if (!epd_ready) {
+        epd_setup();
+    }
+
+    shown_forget();
+    panel_init(true);
+    plane_forget();
+    ESP_LOGI(TAG, "Sending source planes to MASTER and SLAVE");
+    int64_t start_us = esp_timer_get_time();
+    bool ok = send_plane_source(EPD_MASTER_ONLY, 0, source, ctx);
+    record_phase(EPD_PHASE_MASTER_XFER, start_us);
+    if (ok) {
+        start_us = esp_timer_get_time();
+        ok = send_plane_source(EPD_SLAVE_ONLY, 1, source, ctx);
+        record_phase(EPD_PHASE_SLAVE_XFER, start_us);
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "Plane source aborted, panel not refreshed");
+        return EPD_SHOW_INVALID;
+    }
+    epd_display(PIC_A);
+    epd_stats_frame_done();
+    return EPD_SHOW_OK;
+}
+
+epd_show_result_t epd_show_image(const uint8_t *image_data, size_t length)
+{
+    return epd_show_frame(image_data, length, EPD_FRAME_SP6);
 }
 
 void epd_demo_run(void)
@@ -397,7 +1049,8 @@ void epd_demo_run(void)
     epd_setup();
 
     ESP_LOGI(TAG, "EPD demo: stripe pattern");
-    read_otp_pwr(TEMPTR_ON);
+    shown_forget();
+    panel_init(true);
     send_hv_stripe_data();
     epd_display(PIC_A);
     enter_deepsleep();
@@ -1,11 +1,57 @@
 #ifndef EPD_169INCH_H
 #define EPD_169INCH_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+typedef enum {
+    EPD_SHOW_OK = 0,
+    EPD_SHOW_UNCHANGED,
+    EPD_SHOW_INVALID,
+    // Accepted by the worker; the outcome arrives through its callback.
+    EPD_SHOW_QUEUED,
+    // Dropped in favour of a newer frame before it reached the panel.
+    EPD_SHOW_SUPERSEDED,
+    // The power domain could not be taken for the refresh.
+    EPD_SHOW_BUSY,
+} epd_show_result_t;
+
+typedef enum {
+    // Column-major 4bpp image as produced by tools/image_to_epd.py.
+    EPD_FRAME_SP6 = 0,
+    // Master plane then slave plane, each already in controller RAM order.
+    EPD_FRAME_NATIVE,
+} epd_frame_format_t;
+
+#define EPD_FRAME_BYTES (400U * 400U / 2U)
+#define EPD_PLANE_BYTES (EPD_FRAME_BYTES / 2U)
+// "SP6N" container: magic, little-endian payload size, then a native frame.
+#define EPD_SP6N_HEADER_BYTES 8U
+
+// Writes len bytes of controller plane `plane` (0 master, 1 slave) starting at
+// offset into out, a DMA bounce buffer owned by the bus. Planes are produced
+// in order, each in offsets 0..EPD_PLANE_BYTES. Returning false aborts.
+typedef bool (*epd_plane_source_t)(void *ctx, unsigned plane, uint32_t offset,
+                                   uint8_t *out, size_t len);
+
 void epd_demo_run(void);
 void epd_setup(void);
-void epd_show_image(const uint8_t *image_data, size_t length);
+epd_show_result_t epd_show_image(const uint8_t *image_data, size_t length);
+epd_show_result_t epd_show_frame(const uint8_t *frame, size_t length, epd_frame_format_t format);
+// Refreshes the panel from a plane source instead of a frame in memory. The
+// displayed-frame hash is dropped since the picture is not known up front.
+epd_show_result_t epd_show_source(epd_plane_source_t source, void *ctx);
+// Checks the EPD_SP6N_HEADER_BYTES that start an SP6N container.
+bool epd_native_header_valid(const uint8_t *header);
+// Accepts a bare sp6 frame or an SP6N container and points at the frame bytes.
+bool epd_parse_frame(const uint8_t *data, size_t length, const uint8_t **frame,
+                     epd_frame_format_t *format);
+// True when the frame matches what the panel already shows.
+bool epd_frame_unchanged(const uint8_t *frame, size_t length, epd_frame_format_t format);
+// Seeds the displayed-frame hash at boot from a stored copy of the last
+// frame; it is only accepted if it matches the hash saved after that refresh.
+// Returns true when the panel already shows the frame.
+bool epd_restore_displayed_frame(const uint8_t *frame, size_t length, epd_frame_format_t format);
 
 #endif
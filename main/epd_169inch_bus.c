@@ -1,11 +1,16 @@
 #include "epd_169inch_bus.h"
 
+#include <string.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
+#include "esp_attr.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
 #include "esp_rom_sys.h"
 #include "esp_timer.h"
 
@@ -13,11 +18,38 @@
 
 #define EPD_SPI_HOST SPI2_HOST
 #define EPD_SPI_CLOCK_HZ 250000
+#define EPD_SPI_CHUNK_SIZE 4000
+#define EPD_SPI_QUEUE_DEPTH 2
+#define EPD_SPI_FILL_SIZE 1000
+
+#define EPD_BUSY_TIMEOUT_DEFAULT_MS 10000
+#define EPD_BUSY_TIMEOUT_POWER_ON_MS 3000
+#define EPD_BUSY_TIMEOUT_REFRESH_MS 45000
+#define EPD_BUSY_TIMEOUT_POWER_OFF_MS 3000
+#define EPD_BUSY_TIMEOUT_TEMPTR_MS 1000
 
 static const char *TAG = "epd_bus";
 
 static spi_device_handle_t spi_handle;
 static bool spi_ready;
+static uint32_t spi_clock_hz = EPD_SPI_CLOCK_HZ;
+
+static uint8_t *stream_buf[EPD_SPI_QUEUE_DEPTH];
+static uint8_t *fill_buf;
+static int fill_value = -1;
+static spi_transaction_t stream_trans[EPD_SPI_QUEUE_DEPTH];
+static size_t stream_next;
+static size_t stream_inflight;
+static bool stream_open;
+
+static volatile TaskHandle_t busy_waiter;
+
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+static epd_bus_trace_entry_t trace_ring[EPD_BUS_TRACE_DEPTH];
+static size_t trace_head;
+static epd_bus_trace_entry_t trace_cur;
+static bool trace_cur_open;
+static epd_bus_metrics_t trace_metrics;
 
 static inline void delay_us(uint32_t time_us)
 {
@@ -60,6 +92,19 @@ static inline void csb2_low(void) { gpio_set_level(PIN_CSB2, 0); }
 static inline void ms_high(void) { gpio_set_level(PIN_MS, 1); }
 static inline void ms_low(void) { gpio_set_level(PIN_MS, 0); }
 
+static void spi_add_device(void)
+{
+    spi_device_interface_config_t devcfg = {
+        .clock_speed_hz = (int)spi_clock_hz,
+        .mode = 0,
+        .spics_io_num = -1,
+        .queue_size = EPD_SPI_QUEUE_DEPTH,
+        .flags = SPI_DEVICE_3WIRE | SPI_DEVICE_HALFDUPLEX,
+    };
+
+    ESP_ERROR_CHECK(spi_bus_add_device(EPD_SPI_HOST, &devcfg, &spi_handle));
+}
+
 static void spi_init(void)
 {
     if (spi_ready) {
@@ -72,15 +117,7 @@ static void spi_init(void)
         .sclk_io_num = PIN_SCL,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
-        .max_transfer_sz = 0,
-    };
-
-    spi_device_interface_config_t devcfg = {
-        .clock_speed_hz = EPD_SPI_CLOCK_HZ,
-        .mode = 0,
-        .spics_io_num = -1,
-        .queue_size = 1,
-        .flags = SPI_DEVICE_3WIRE | SPI_DEVICE_HALFDUPLEX,
+        .max_transfer_sz = EPD_SPI_CHUNK_SIZE,
     };
 
     esp_err_t ret = spi_bus_initialize(EPD_SPI_HOST, &buscfg, SPI_DMA_CH_AUTO);
@@ -88,18 +125,173 @@ static void spi_init(void)
         ESP_ERROR_CHECK(ret);
     }
 
-    ESP_ERROR_CHECK(spi_bus_add_device(EPD_SPI_HOST, &devcfg, &spi_handle));
+    spi_add_device();
+
+    for (size_t i = 0; i < EPD_SPI_QUEUE_DEPTH; i++) {
+        stream_buf[i] = heap_caps_malloc(EPD_SPI_CHUNK_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (!stream_buf[i]) {
+            ESP_LOGE(TAG, "Failed to allocate DMA stream buffer");
+            ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+        }
+    }
+    fill_buf = heap_caps_malloc(EPD_SPI_FILL_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!fill_buf) {
+        ESP_LOGE(TAG, "Failed to allocate DMA fill buffer");
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
     spi_ready = true;
 }
 
-static void spi_write_byte(uint8_t value)
+static epd_bus_opcode_stats_t *trace_opcode_slot(uint8_t opcode)
+{
+    for (size_t i = 0; i < trace_metrics.opcode_count; i++) {
+        if (trace_metrics.opcodes[i].opcode == opcode) {
+            return &trace_metrics.opcodes[i];
+        }
+    }
+    // Only a dozen opcodes are ever used; anything past the table still
+    // lands in the global counters.
+    if (trace_metrics.opcode_count == EPD_BUS_TRACE_OPCODES) {
+        return NULL;
+    }
+    epd_bus_opcode_stats_t *slot = &trace_metrics.opcodes[trace_metrics.opcode_count++];
+    slot->opcode = opcode;
+    return slot;
+}
+
+static void trace_commit_locked(void)
+{
+    if (!trace_cur_open) {
+        return;
+    }
+
+    trace_ring[trace_head] = trace_cur;
+    trace_head = (trace_head + 1U) % EPD_BUS_TRACE_DEPTH;
+    trace_metrics.trace_total++;
+    trace_cur_open = false;
+
+    epd_bus_opcode_stats_t *slot = trace_opcode_slot(trace_cur.opcode);
+    if (slot) {
+        slot->count++;
+        slot->data_bytes += trace_cur.data_bytes;
+        slot->read_bytes += trace_cur.read_bytes;
+        slot->spi_us += trace_cur.spi_us;
+        slot->busy_us += trace_cur.busy_us;
+    }
+}
+
+static void trace_open_locked(uint8_t opcode, epd_ms_target_t target, int64_t now_us)
+{
+    trace_commit_locked();
+    trace_cur = (epd_bus_trace_entry_t){
+        .start_ms = (uint32_t)(now_us / 1000),
+        .opcode = opcode,
+        .target = (uint8_t)target,
+    };
+    trace_cur_open = true;
+}
+
+static void trace_command(uint8_t opcode, epd_ms_target_t target)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&trace_lock);
+    trace_open_locked(opcode, target, now_us);
+    trace_metrics.commands++;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+static uint16_t trace_add_u16(uint16_t a, size_t b)
+{
+    size_t sum = (size_t)a + b;
+    return sum > UINT16_MAX ? UINT16_MAX : (uint16_t)sum;
+}
+
+static void trace_transfer(size_t data_bytes, size_t read_bytes, uint32_t spi_us)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&trace_lock);
+    if (!trace_cur_open) {
+        trace_open_locked(EPD_CMD_NONE, EPD_MASTER_SLAVE, now_us);
+    }
+    trace_cur.data_bytes = trace_add_u16(trace_cur.data_bytes, data_bytes);
+    trace_cur.read_bytes = trace_add_u16(trace_cur.read_bytes, read_bytes);
+    trace_cur.spi_us += spi_us;
+    trace_metrics.data_bytes += data_bytes;
+    trace_metrics.read_bytes += read_bytes;
+    trace_metrics.spi_us += spi_us;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+static void trace_busy(uint32_t busy_us, bool timed_out)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&trace_lock);
+    if (!trace_cur_open) {
+        trace_open_locked(EPD_CMD_NONE, EPD_MASTER_SLAVE, now_us);
+    }
+    trace_cur.busy_us += busy_us;
+    trace_cur.busy_timeout |= timed_out;
+    trace_metrics.busy_waits++;
+    trace_metrics.busy_us += busy_us;
+    if (timed_out) {
+        trace_metrics.busy_timeouts++;
+    }
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+static void trace_reset(void)
+{
+    portENTER_CRITICAL(&trace_lock);
+    trace_commit_locked();
+    trace_metrics.resets++;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+size_t epd_bus_get_metrics(epd_bus_metrics_t *metrics, epd_bus_trace_entry_t *entries,
+                           size_t max_entries)
+{
+    size_t count = 0;
+
+    portENTER_CRITICAL(&trace_lock);
+    if (metrics) {
+        *metrics = trace_metrics;
+    }
+    if (entries && max_entries > 0) {
+        size_t stored = trace_metrics.trace_total < EPD_BUS_TRACE_DEPTH
+                            ? trace_metrics.trace_total
+                            : EPD_BUS_TRACE_DEPTH;
+        // The open entry is the newest one and takes a slot of its own.
+        size_t want = stored + (trace_cur_open ? 1U : 0U);
+        if (want > max_entries) {
+            want = max_entries;
+        }
+        size_t from_ring = want - (trace_cur_open ? 1U : 0U);
+        size_t idx = (trace_head + EPD_BUS_TRACE_DEPTH - from_ring) % EPD_BUS_TRACE_DEPTH;
+        for (size_t i = 0; i < from_ring; i++) {
+            entries[count++] = trace_ring[idx];
+            idx = (idx + 1U) % EPD_BUS_TRACE_DEPTH;
+        }
+        if (trace_cur_open && count < want) {
+            entries[count++] = trace_cur;
+        }
+    }
+    portEXIT_CRITICAL(&trace_lock);
+    return count;
+}
+
+static uint32_t spi_write_byte(uint8_t value)
 {
     spi_transaction_t t = {
         .length = 8,
         .flags = SPI_TRANS_USE_TXDATA,
     };
     t.tx_data[0] = value;
+    int64_t start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(spi_device_polling_transmit(spi_handle, &t));
+    return (uint32_t)(esp_timer_get_time() - start_us);
 }
 
 static uint8_t spi_read_byte(void)
@@ -109,10 +301,28 @@ static uint8_t spi_read_byte(void)
         .rxlength = 8,
         .flags = SPI_TRANS_USE_RXDATA,
     };
+    int64_t start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(spi_device_polling_transmit(spi_handle, &t));
+    trace_transfer(0, 1, (uint32_t)(esp_timer_get_time() - start_us));
     return t.rx_data[0];
 }
 
+static void stream_wait_one(void)
+{
+    spi_transaction_t *done = NULL;
+    int64_t start_us = esp_timer_get_time();
+    ESP_ERROR_CHECK(spi_device_get_trans_result(spi_handle, &done, portMAX_DELAY));
+    trace_transfer(0, 0, (uint32_t)(esp_timer_get_time() - start_us));
+    stream_inflight--;
+}
+
+static void stream_drain(void)
+{
+    while (stream_inflight > 0) {
+        stream_wait_one();
+    }
+}
+
 static void select_target(epd_ms_target_t target)
 {
     if (target == EPD_MASTER_ONLY) {
@@ -127,6 +337,35 @@ static void select_target(epd_ms_target_t target)
     }
 }
 
+static void IRAM_ATTR busy_isr(void *arg)
+{
+    (void)arg;
+    TaskHandle_t waiter = busy_waiter;
+    if (!waiter) {
+        return;
+    }
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(waiter, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static uint32_t busy_timeout_ms(uint8_t cmd)
+{
+    switch (cmd) {
+        case EPD_CMD_POWER_ON:
+            return EPD_BUSY_TIMEOUT_POWER_ON_MS;
+        case EPD_CMD_REFRESH:
+            return EPD_BUSY_TIMEOUT_REFRESH_MS;
+        case EPD_CMD_POWER_OFF:
+            return EPD_BUSY_TIMEOUT_POWER_OFF_MS;
+        case EPD_CMD_TEMPTR:
+            return EPD_BUSY_TIMEOUT_TEMPTR_MS;
+        default:
+            return EPD_BUSY_TIMEOUT_DEFAULT_MS;
+    }
+}
+
 void epd_bus_init(void)
 {
     gpio_config_t io_conf = {
@@ -141,8 +380,15 @@ void epd_bus_init(void)
 
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pin_bit_mask = (1ULL << PIN_BUSY);
+    io_conf.intr_type = GPIO_INTR_POSEDGE;
     gpio_config(&io_conf);
 
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_CHECK(ret);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(PIN_BUSY, busy_isr, NULL));
+
     nrst_high();
     ndc_high();
     csb_high();
@@ -158,26 +404,71 @@ void epd_bus_init(void)
     spi_init();
 }
 
-void epd_bus_wait_busy(void)
+void epd_bus_set_clock_hz(uint32_t hz)
 {
-    int64_t deadline_us = esp_timer_get_time() + 10 * 1000 * 1000;
+    if (hz == 0) {
+        hz = EPD_SPI_CLOCK_HZ;
+    }
+    if (hz == spi_clock_hz) {
+        return;
+    }
 
-    while (true) {
-        if (gpio_get_level(PIN_BUSY)) {
-            ESP_LOGI(TAG, "Busy signal cleared");
-            break;
-        }
+    spi_clock_hz = hz;
+    if (!spi_ready) {
+        return;
+    }
 
-        epd_bus_delay_ms(10);
-        if (esp_timer_get_time() > deadline_us) {
-            ESP_LOGW(TAG, "Busy signal timeout");
+    if (stream_open) {
+        epd_bus_stream_end();
+    }
+    ESP_ERROR_CHECK(spi_bus_remove_device(spi_handle));
+    spi_add_device();
+    ESP_LOGI(TAG, "SPI clock set to %u Hz", (unsigned)spi_clock_hz);
+}
+
+uint32_t epd_bus_get_clock_hz(void)
+{
+    return spi_clock_hz;
+}
+
+uint32_t epd_bus_get_default_clock_hz(void)
+{
+    return EPD_SPI_CLOCK_HZ;
+}
+
+uint32_t epd_bus_wait_busy(uint8_t cmd)
+{
+    int64_t start_us = esp_timer_get_time();
+    int64_t deadline_us = start_us + (int64_t)busy_timeout_ms(cmd) * 1000;
+    bool timed_out = false;
+
+    // BUSY is low while the controller works; the ISR fires on the rising edge.
+    busy_waiter = xTaskGetCurrentTaskHandle();
+    (void)ulTaskNotifyTake(pdTRUE, 0);
+    while (!gpio_get_level(PIN_BUSY)) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            timed_out = true;
             break;
         }
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((uint32_t)(remaining_us / 1000) + 1U));
     }
+    busy_waiter = NULL;
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    trace_busy((uint32_t)elapsed_us, timed_out);
+    uint32_t elapsed_ms = (uint32_t)(elapsed_us / 1000);
+    if (timed_out) {
+        ESP_LOGW(TAG, "Busy signal timeout after %u ms (cmd 0x%02X)", (unsigned)elapsed_ms, cmd);
+    } else {
+        ESP_LOGI(TAG, "Busy signal cleared after %u ms (cmd 0x%02X)", (unsigned)elapsed_ms, cmd);
+    }
+    return elapsed_ms;
 }
 
 void epd_bus_reset(void)
 {
+    trace_reset();
     nrst_high();
     epd_bus_delay_ms(30);
     nrst_low();
@@ -189,11 +480,12 @@ void epd_bus_reset(void)
 
 void epd_bus_write_cmd(epd_ms_target_t target, uint8_t cmd)
 {
+    trace_command(cmd, target);
     select_target(target);
     delay_us(2);
     ndc_low();
     delay_us(1);
-    spi_write_byte(cmd);
+    trace_transfer(0, 0, spi_write_byte(cmd));
     delay_us(1);
     delay_us(2);
     csb_high();
@@ -207,7 +499,7 @@ void epd_bus_write_data(epd_ms_target_t target, uint8_t data)
     delay_us(2);
     ndc_high();
     delay_us(1);
-    spi_write_byte(data);
+    trace_transfer(1, 0, spi_write_byte(data));
     delay_us(1);
     delay_us(2);
     csb_high();
@@ -229,6 +521,141 @@ uint8_t epd_bus_read_data(epd_ms_target_t target)
     return temp;
 }
 
+void epd_bus_stream_begin(epd_ms_target_t target)
+{
+    if (stream_open) {
+        epd_bus_stream_end();
+    }
+
+    select_target(target);
+    delay_us(2);
+    ndc_high();
+    delay_us(1);
+    stream_next = 0;
+    stream_inflight = 0;
+    stream_open = true;
+}
+
+static void stream_queue(const uint8_t *src, size_t len)
+{
+    // Both slots in flight: the oldest one owns the slot we are about to reuse.
+    if (stream_inflight == EPD_SPI_QUEUE_DEPTH) {
+        stream_wait_one();
+    }
+
+    spi_transaction_t *t = &stream_trans[stream_next];
+    memset(t, 0, sizeof(*t));
+    t->length = len * 8U;
+    t->tx_buffer = src;
+    int64_t start_us = esp_timer_get_time();
+    ESP_ERROR_CHECK(spi_device_queue_trans(spi_handle, t, portMAX_DELAY));
+    trace_transfer(len, 0, (uint32_t)(esp_timer_get_time() - start_us));
+    stream_inflight++;
+    stream_next = (stream_next + 1U) % EPD_SPI_QUEUE_DEPTH;
+}
+
+uint8_t *epd_bus_stream_acquire(size_t *capacity)
+{
+    if (!stream_open) {
+        return NULL;
+    }
+
+    if (stream_inflight == EPD_SPI_QUEUE_DEPTH) {
+        stream_wait_one();
+    }
+    *capacity = EPD_SPI_CHUNK_SIZE;
+    return stream_buf[stream_next];
+}
+
+void epd_bus_stream_commit(size_t len)
+{
+    if (!stream_open || len == 0 || len > EPD_SPI_CHUNK_SIZE) {
+        return;
+    }
+    stream_queue(stream_buf[stream_next], len);
+}
+
+void epd_bus_stream_write(const uint8_t *buf, size_t len)
+{
+    if (!stream_open || !buf) {
+        return;
+    }
+
+    while (len > 0) {
+        size_t capacity = 0;
+        uint8_t *dst = epd_bus_stream_acquire(&capacity);
+        size_t chunk = len < capacity ? len : capacity;
+
+        memcpy(dst, buf, chunk);
+        epd_bus_stream_commit(chunk);
+
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+void epd_bus_stream_write_inplace(const uint8_t *buf, size_t len)
+{
+    // PSRAM or unaligned sources would be bounced by the SPI driver anyway,
+    // and our own bounce buffers are cheaper than its per-transaction malloc.
+    if (!buf || !esp_ptr_dma_capable(buf) || ((uintptr_t)buf & 3U) != 0) {
+        epd_bus_stream_write(buf, len);
+        return;
+    }
+    if (!stream_open) {
+        return;
+    }
+
+    while (len > 0) {
+        size_t chunk = len < EPD_SPI_CHUNK_SIZE ? len : EPD_SPI_CHUNK_SIZE;
+        stream_queue(buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+void epd_bus_stream_fill(uint8_t value, size_t len)
+{
+    if (!stream_open) {
+        return;
+    }
+
+    // Every transaction points at the same small buffer, so a whole plane of
+    // one value needs no source data beyond EPD_SPI_FILL_SIZE bytes.
+    if (fill_value != value) {
+        stream_drain();
+        memset(fill_buf, value, EPD_SPI_FILL_SIZE);
+        fill_value = value;
+    }
+
+    while (len > 0) {
+        size_t chunk = len < EPD_SPI_FILL_SIZE ? len : EPD_SPI_FILL_SIZE;
+        stream_queue(fill_buf, chunk);
+        len -= chunk;
+    }
+}
+
+void epd_bus_stream_end(void)
+{
+    if (!stream_open) {
+        return;
+    }
+
+    stream_drain();
+    delay_us(2);
+    csb_high();
+    csb2_high();
+    delay_us(2);
+    stream_open = false;
+}
+
+void epd_bus_write_data_buf(epd_ms_target_t target, const uint8_t *buf, size_t len)
+{
+    epd_bus_stream_begin(target);
+    epd_bus_stream_write(buf, len);
+    epd_bus_stream_end();
+}
+
 void epd_bus_set_master_mode(bool high)
 {
     if (high) {
@@ -2,23 +2,97 @@
 #define EPD_169INCH_BUS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#define EPD_CMD_POWER_OFF 0x02
+#define EPD_CMD_POWER_ON 0x04
+#define EPD_CMD_REFRESH 0x12
+#define EPD_CMD_TEMPTR 0x40
+#define EPD_CMD_NONE 0xFF
+
+#define EPD_BUS_TRACE_DEPTH 64
+#define EPD_BUS_TRACE_OPCODES 16
+
 typedef enum {
     EPD_MASTER_ONLY = 0,
     EPD_SLAVE_ONLY = 1,
     EPD_MASTER_SLAVE = 2,
 } epd_ms_target_t;
 
+// One trace entry per command: the opcode plus the data bytes, reads and
+// BUSY wait that followed it up to the next command.
+typedef struct {
+    uint32_t start_ms;
+    uint32_t spi_us;
+    uint32_t busy_us;
+    uint16_t data_bytes;
+    uint16_t read_bytes;
+    uint8_t opcode;
+    uint8_t target;
+    bool busy_timeout;
+} epd_bus_trace_entry_t;
+
+typedef struct {
+    uint8_t opcode;
+    uint32_t count;
+    uint32_t data_bytes;
+    uint32_t read_bytes;
+    uint64_t spi_us;
+    uint64_t busy_us;
+} epd_bus_opcode_stats_t;
+
+typedef struct {
+    uint32_t commands;
+    uint32_t resets;
+    uint32_t busy_waits;
+    uint32_t busy_timeouts;
+    uint32_t trace_total;
+    uint64_t data_bytes;
+    uint64_t read_bytes;
+    uint64_t spi_us;
+    uint64_t busy_us;
+    size_t opcode_count;
+    epd_bus_opcode_stats_t opcodes[EPD_BUS_TRACE_OPCODES];
+} epd_bus_metrics_t;
+
 void epd_bus_init(void);
 void epd_bus_reset(void);
-void epd_bus_wait_busy(void);
+// Blocks until BUSY goes high or the per-command timeout expires and
+// returns how long the controller stayed busy, in milliseconds.
+uint32_t epd_bus_wait_busy(uint8_t cmd);
 void epd_bus_delay_ms(uint32_t time_ms);
 void epd_bus_delay_s(uint32_t time_s);
 void epd_bus_set_master_mode(bool high);
+void epd_bus_set_clock_hz(uint32_t hz);
+uint32_t epd_bus_get_clock_hz(void);
+uint32_t epd_bus_get_default_clock_hz(void);
 
 void epd_bus_write_cmd(epd_ms_target_t target, uint8_t cmd);
 void epd_bus_write_data(epd_ms_target_t target, uint8_t data);
 uint8_t epd_bus_read_data(epd_ms_target_t target);
 
+// Bulk data transfer: CS stays low and DC high from begin to end, and the
+// payload goes out as queued DMA transactions through internal bounce buffers.
+// EPD_MASTER_SLAVE streams the same bytes into both controllers at once.
+void epd_bus_stream_begin(epd_ms_target_t target);
+void epd_bus_stream_write(const uint8_t *buf, size_t len);
+// Like epd_bus_stream_write, but DMA-capable buffers are sent without a copy,
+// so buf must stay untouched until epd_bus_stream_end.
+void epd_bus_stream_write_inplace(const uint8_t *buf, size_t len);
+void epd_bus_stream_fill(uint8_t value, size_t len);
+// Zero-copy producer path: acquire hands out the next free DMA bounce buffer
+// (waiting for the oldest transfer if both are in flight) and commit queues
+// the first len bytes of it. One buffer fills while the other is on the wire.
+uint8_t *epd_bus_stream_acquire(size_t *capacity);
+void epd_bus_stream_commit(size_t len);
+void epd_bus_stream_end(void);
+void epd_bus_write_data_buf(epd_ms_target_t target, const uint8_t *buf, size_t len);
+
+// Copies the cumulative counters and up to max_entries of the most recent
+// trace entries, oldest first, and returns how many entries were written.
+// Safe to call from any task while the panel is being driven.
+size_t epd_bus_get_metrics(epd_bus_metrics_t *metrics, epd_bus_trace_entry_t *entries,
+                           size_t max_entries);
+
 #endif
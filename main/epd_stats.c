@@ -0,0 +1,234 @@
+#include "epd_stats.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define EPD_STATS_NVS_NAMESPACE "epd"
+#define EPD_STATS_NVS_KEY "stats"
+#define EPD_STATS_MAGIC 0x45505354U
+#define EPD_STATS_VERSION 1U
+
+static const char *TAG = "epd_stats";
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    epd_stats_t stats;
+    uint32_t crc;
+} epd_stats_blob_t;
+
+static const char *const s_phase_names[EPD_PHASE_COUNT] = {
+    [EPD_PHASE_RESET] = "reset",
+    [EPD_PHASE_OTP_READ] = "otp_read",
+    [EPD_PHASE_TEMPERATURE] = "temperature",
+    [EPD_PHASE_MASTER_XFER] = "master_xfer",
+    [EPD_PHASE_SLAVE_XFER] = "slave_xfer",
+    [EPD_PHASE_POWER_ON] = "power_on",
+    [EPD_PHASE_REFRESH] = "refresh",
+    [EPD_PHASE_POWER_OFF] = "power_off",
+};
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static epd_stats_t s_stats;
+static uint32_t s_unsaved_frames;
+static bool s_nvs_ready;
+
+static bool ensure_nvs_ready(void)
+{
+    if (s_nvs_ready) {
+        return true;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_OK) {
+        s_nvs_ready = true;
+        return true;
+    }
+
+    ESP_LOGW(TAG, "NVS init failed: %s", esp_err_to_name(err));
+    return false;
+}
+
+static uint32_t blob_checksum(const epd_stats_blob_t *blob)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)blob, offsetof(epd_stats_blob_t, crc));
+}
+
+static size_t bucket_index(uint32_t us)
+{
+    if (us < (1U << EPD_STATS_MIN_SHIFT)) {
+        return 0;
+    }
+
+    unsigned msb = 31U - (unsigned)__builtin_clz(us);
+    if (msb >= EPD_STATS_MIN_SHIFT + EPD_STATS_OCTAVES) {
+        return EPD_STATS_BUCKETS - 1U;
+    }
+    unsigned sub = (us >> (msb - 2U)) & 3U;
+    return 1U + ((msb - EPD_STATS_MIN_SHIFT) * 4U) + sub;
+}
+
+void epd_stats_bucket_range(size_t bucket, uint32_t *lower_us, uint32_t *upper_us)
+{
+    if (bucket == 0) {
+        *lower_us = 0;
+        *upper_us = 1U << EPD_STATS_MIN_SHIFT;
+        return;
+    }
+
+    size_t k = bucket - 1U;
+    unsigned shift = EPD_STATS_MIN_SHIFT + (unsigned)(k / 4U) - 2U;
+    *lower_us = (uint32_t)(4U + (k % 4U)) << shift;
+    *upper_us = *lower_us + (1U << shift);
+}
+
+const char *epd_stats_phase_name(epd_phase_t phase)
+{
+    return phase < EPD_PHASE_COUNT ? s_phase_names[phase] : "unknown";
+}
+
+void epd_stats_init(void)
+{
+    // A few KB: too big for app_main's stack, which this runs on.
+    static epd_stats_blob_t blob;
+
+    if (!ensure_nvs_ready()) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(EPD_STATS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    size_t len = sizeof(blob);
+    esp_err_t err = nvs_get_blob(handle, EPD_STATS_NVS_KEY, &blob, &len);
+    nvs_close(handle);
+
+    if (err != ESP_OK || len != sizeof(blob) || blob.magic != EPD_STATS_MAGIC ||
+        blob.version != EPD_STATS_VERSION || blob.crc != blob_checksum(&blob)) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats = blob.stats;
+    portEXIT_CRITICAL(&s_lock);
+    ESP_LOGI(TAG, "Restored refresh stats for %u frames", (unsigned)blob.stats.frames);
+}
+
+static void stats_save(void)
+{
+    static epd_stats_blob_t blob;
+
+    if (!ensure_nvs_ready()) {
+        return;
+    }
+
+    memset(&blob, 0, sizeof(blob));
+    blob.magic = EPD_STATS_MAGIC;
+    blob.version = EPD_STATS_VERSION;
+    portENTER_CRITICAL(&s_lock);
+    memcpy(&blob.stats, &s_stats, sizeof(blob.stats));
+    portEXIT_CRITICAL(&s_lock);
+    blob.crc = blob_checksum(&blob);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(EPD_STATS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "NVS open failed: %s", esp_err_to_name(err));
+        return;
+    }
+    err = nvs_set_blob(handle, EPD_STATS_NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "NVS save failed: %s", esp_err_to_name(err));
+    }
+    nvs_close(handle);
+}
+
+void epd_stats_record(epd_phase_t phase, uint32_t duration_us)
+{
+    if (phase >= EPD_PHASE_COUNT) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    epd_phase_hist_t *h = &s_stats.phases[phase];
+    if (h->count == 0 || duration_us < h->min_us) {
+        h->min_us = duration_us;
+    }
+    if (duration_us > h->max_us) {
+        h->max_us = duration_us;
+    }
+    h->count++;
+    h->sum_us += duration_us;
+    h->buckets[bucket_index(duration_us)]++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void epd_stats_set_temperature(int8_t celsius)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_stats.temperature = celsius;
+    s_stats.temperature_valid = true;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void epd_stats_frame_done(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_stats.frames++;
+    portEXIT_CRITICAL(&s_lock);
+
+    s_unsaved_frames++;
+    if (s_unsaved_frames < EPD_STATS_SAVE_EVERY) {
+        return;
+    }
+    s_unsaved_frames = 0;
+    stats_save();
+}
+
+void epd_stats_get(epd_stats_t *out)
+{
+    portENTER_CRITICAL(&s_lock);
+    memcpy(out, &s_stats, sizeof(*out));
+    portEXIT_CRITICAL(&s_lock);
+}
+
+uint32_t epd_stats_percentile(const epd_phase_hist_t *hist, uint32_t percent)
+{
+    if (!hist || hist->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (((uint64_t)hist->count * percent) + 99U) / 100U;
+    rank = rank ? rank : 1U;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < EPD_STATS_BUCKETS; i++) {
+        uint32_t n = hist->buckets[i];
+        if (n == 0 || seen + n < rank) {
+            seen += n;
+            continue;
+        }
+
+        uint32_t lower;
+        uint32_t upper;
+        epd_stats_bucket_range(i, &lower, &upper);
+        uint64_t value = lower + (((uint64_t)(upper - lower) * (rank - seen)) / n);
+        if (value < hist->min_us) {
+            value = hist->min_us;
+        }
+        if (value > hist->max_us) {
+            value = hist->max_us;
+        }
+        return (uint32_t)value;
+    }
+    return hist->max_us;
+}
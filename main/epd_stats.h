@@ -0,0 +1,58 @@
+#ifndef EPD_STATS_H
+#define EPD_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Refresh phases timed by the driver. The OTP read includes its own reset and
+// temperature read, so the phases overlap when the OTP cache is not in use.
+typedef enum {
+    EPD_PHASE_RESET = 0,
+    EPD_PHASE_OTP_READ,
+    EPD_PHASE_TEMPERATURE,
+    EPD_PHASE_MASTER_XFER,
+    EPD_PHASE_SLAVE_XFER,
+    EPD_PHASE_POWER_ON,
+    EPD_PHASE_REFRESH,
+    EPD_PHASE_POWER_OFF,
+    EPD_PHASE_COUNT,
+} epd_phase_t;
+
+// Quarter-octave buckets: bucket 0 holds everything below 2^EPD_STATS_MIN_SHIFT
+// us, then four buckets per power of two up to 2^(MIN_SHIFT + OCTAVES) us
+// (about 67 s); longer samples land in the last bucket.
+#define EPD_STATS_MIN_SHIFT 8
+#define EPD_STATS_OCTAVES 18
+#define EPD_STATS_BUCKETS (1 + (EPD_STATS_OCTAVES * 4))
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[EPD_STATS_BUCKETS];
+} epd_phase_hist_t;
+
+typedef struct {
+    uint32_t frames;
+    int8_t temperature;
+    bool temperature_valid;
+    epd_phase_hist_t phases[EPD_PHASE_COUNT];
+} epd_stats_t;
+
+// Loads the histograms saved by a previous boot, if any.
+void epd_stats_init(void);
+void epd_stats_record(epd_phase_t phase, uint32_t duration_us);
+void epd_stats_set_temperature(int8_t celsius);
+// Counts a finished refresh and saves to NVS every EPD_STATS_SAVE_EVERY frames.
+void epd_stats_frame_done(void);
+void epd_stats_get(epd_stats_t *out);
+
+const char *epd_stats_phase_name(epd_phase_t phase);
+// Lower and upper bound of a bucket in microseconds.
+void epd_stats_bucket_range(size_t bucket, uint32_t *lower_us, uint32_t *upper_us);
+// Interpolated percentile (0..100) of one phase, clamped to its min and max.
+uint32_t epd_stats_percentile(const epd_phase_hist_t *hist, uint32_t percent);
+
+#endif
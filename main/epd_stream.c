@@ -0,0 +1,96 @@
+#include "epd_stream.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "config.h"
+#include "epd_worker.h"
+#include "esp_log.h"
+
+#define EPD_STREAM_SLICE_MS 100
+
+static const char *TAG = "epd_stream";
+
+static StreamBufferHandle_t s_ring;
+static SemaphoreHandle_t s_done;
+static volatile bool s_aborted;
+static volatile bool s_finished;
+static epd_show_result_t s_result;
+
+// Runs on the worker: fills each bus bounce buffer from the ring.
+static bool stream_source(void *ctx, unsigned plane, uint32_t offset, uint8_t *out, size_t len)
+{
+    (void)ctx;
+    (void)plane;
+    (void)offset;
+
+    size_t filled = 0;
+    uint32_t idle_ms = 0;
+    while (filled < len) {
+        if (s_aborted) {
+            return false;
+        }
+        size_t got = xStreamBufferReceive(s_ring, out + filled, len - filled,
+                                          pdMS_TO_TICKS(EPD_STREAM_SLICE_MS));
+        if (got > 0) {
+            filled += got;
+            idle_ms = 0;
+            continue;
+        }
+        idle_ms += EPD_STREAM_SLICE_MS;
+        if (idle_ms >= EPD_STREAM_TIMEOUT_MS) {
+            ESP_LOGW(TAG, "Stream stalled at plane %u offset %u", plane, (unsigned)(offset + filled));
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stream_done(epd_show_result_t result, void *ctx)
+{
+    (void)ctx;
+    s_result = result;
+    s_finished = true;
+    xSemaphoreGive(s_done);
+}
+
+epd_show_result_t epd_stream_begin(void)
+{
+    if (!s_ring) {
+        s_ring = xStreamBufferCreate(EPD_STREAM_RING_BYTES, 1);
+        s_done = xSemaphoreCreateBinary();
+        if (!s_ring || !s_done) {
+            ESP_LOGE(TAG, "Failed to allocate stream ring");
+            return EPD_SHOW_BUSY;
+        }
+    }
+
+    xStreamBufferReset(s_ring);
+    s_aborted = false;
+    s_finished = false;
+    return epd_submit_source(stream_source, NULL, stream_done, NULL);
+}
+
+bool epd_stream_write(const uint8_t *data, size_t len)
+{
+    // No timeout of our own: the worker always finishes, either by draining
+    // the ring or by giving up on a stall, and that ends this loop too.
+    while (len > 0) {
+        if (s_finished) {
+            return false;
+        }
+        size_t sent = xStreamBufferSend(s_ring, data, len, pdMS_TO_TICKS(EPD_STREAM_SLICE_MS));
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+epd_show_result_t epd_stream_end(bool complete)
+{
+    if (!complete) {
+        s_aborted = true;
+    }
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    return s_result;
+}
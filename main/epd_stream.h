@@ -0,0 +1,23 @@
+#ifndef EPD_STREAM_H
+#define EPD_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "epd_169inch.h"
+
+// Streams a native frame (master plane, then slave plane) to the panel as it
+// is produced: bytes pass through a small ring buffer into the EPD worker's
+// plane transfer, so no frame buffer is needed on either side.
+
+// Queues the streamed refresh on the worker; anything but EPD_SHOW_QUEUED
+// means the stream did not start.
+epd_show_result_t epd_stream_begin(void);
+// Blocks while the ring is full. Returns false once the refresh has given up.
+bool epd_stream_write(const uint8_t *data, size_t len);
+// Pass complete = false to abort a partial frame. Waits for the worker and
+// returns its result (EPD_SHOW_INVALID for an aborted frame).
+epd_show_result_t epd_stream_end(bool complete);
+
+#endif
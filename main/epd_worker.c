@@ -0,0 +1,281 @@
+#include "epd_worker.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "frame_pool.h"
+
+#define EPD_WORKER_STACK 4096
+#define EPD_WORKER_PRIORITY 4
+#define EPD_WORKER_POWER_TIMEOUT_MS 60000
+#define EPD_WORKER_ACQUIRE_TIMEOUT_MS 1000
+
+static const char *TAG = "epd_worker";
+
+static TaskHandle_t s_task;
+static SemaphoreHandle_t s_lock;
+static EventGroupHandle_t s_events;
+static epd_power_begin_t s_power_begin;
+static epd_power_end_t s_power_end;
+
+// The mailbox slot holds a reference to a frame pool buffer, or a borrowed
+// frame the submitter keeps alive. The worker takes it over when it picks the
+// frame up and releases it after the refresh (a no-op for borrowed frames), so
+// submitters never wait on a refresh.
+static const uint8_t *s_pending;
+static epd_frame_format_t s_pending_format;
+static bool s_has_pending;
+static epd_frame_done_cb_t s_pending_cb;
+static void *s_pending_ctx;
+
+// A plane source job runs ahead of the frame mailbox and is never replaced:
+// its producer is feeding it while it runs.
+static epd_plane_source_t s_source;
+static void *s_source_ctx;
+static epd_frame_done_cb_t s_source_cb;
+static void *s_source_cb_ctx;
+
+static void notify_done(epd_frame_done_cb_t cb, void *ctx, epd_show_result_t result)
+{
+    if (cb) {
+        cb(result, ctx);
+    }
+}
+
+static epd_show_result_t show_frame(const uint8_t *frame, epd_frame_format_t format)
+{
+    // Identical frames never need the power domain.
+    if (epd_frame_unchanged(frame, EPD_FRAME_BYTES, format)) {
+        return epd_show_frame(frame, EPD_FRAME_BYTES, format);
+    }
+
+    if (s_power_begin && !s_power_begin(EPD_WORKER_POWER_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "Power domain busy, skipping display update");
+        return EPD_SHOW_BUSY;
+    }
+    epd_show_result_t result = epd_show_frame(frame, EPD_FRAME_BYTES, format);
+    if (s_power_end) {
+        s_power_end();
+    }
+    return result;
+}
+
+static epd_show_result_t show_source(epd_plane_source_t source, void *ctx)
+{
+    if (s_power_begin && !s_power_begin(EPD_WORKER_POWER_TIMEOUT_MS)) {
+        ESP_LOGW(TAG, "Power domain busy, skipping streamed update");
+        return EPD_SHOW_BUSY;
+    }
+    epd_show_result_t result = epd_show_source(source, ctx);
+    if (s_power_end) {
+        s_power_end();
+    }
+    return result;
+}
+
+static void run_source_job(void)
+{
+    epd_plane_source_t source = s_source;
+    void *ctx = s_source_ctx;
+    epd_frame_done_cb_t cb = s_source_cb;
+    void *cb_ctx = s_source_cb_ctx;
+    xSemaphoreGive(s_lock);
+
+    epd_show_result_t result = show_source(source, ctx);
+    ESP_LOGI(TAG, "Streamed frame finished (result %d)", (int)result);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_source = NULL;
+    xSemaphoreGive(s_lock);
+    xEventGroupSetBits(s_events, EPD_WORKER_BIT_DONE);
+    notify_done(cb, cb_ctx, result);
+}
+
+static void epd_worker_task(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            if (s_source) {
+                run_source_job();
+                continue;
+            }
+            if (!s_has_pending) {
+                xEventGroupSetBits(s_events, EPD_WORKER_BIT_IDLE);
+                xEventGroupClearBits(s_events, EPD_WORKER_BIT_BUSY);
+                xSemaphoreGive(s_lock);
+                break;
+            }
+            const uint8_t *frame = s_pending;
+            epd_frame_format_t format = s_pending_format;
+            epd_frame_done_cb_t cb = s_pending_cb;
+            void *ctx = s_pending_ctx;
+            s_has_pending = false;
+            s_pending = NULL;
+            s_pending_cb = NULL;
+            s_pending_ctx = NULL;
+            xSemaphoreGive(s_lock);
+
+            epd_show_result_t result = show_frame(frame, format);
+            frame_pool_release(frame);
+            ESP_LOGI(TAG, "Frame finished (result %d)", (int)result);
+            xEventGroupSetBits(s_events, EPD_WORKER_BIT_DONE);
+            notify_done(cb, ctx, result);
+        }
+    }
+}
+
+void epd_worker_start(epd_power_begin_t power_begin, epd_power_end_t power_end)
+{
+    if (s_task) {
+        return;
+    }
+
+    s_power_begin = power_begin;
+    s_power_end = power_end;
+    s_lock = xSemaphoreCreateMutex();
+    s_events = xEventGroupCreate();
+    if (!s_lock || !s_events) {
+        ESP_LOGE(TAG, "Failed to allocate EPD worker");
+        return;
+    }
+    // Only copied frames need the pool; sources and borrowed frames run
+    // without it, so boards without PSRAM can still stream.
+    if (!frame_pool_init()) {
+        ESP_LOGW(TAG, "No frame pool, only streamed and borrowed frames can be queued");
+    }
+
+    xEventGroupSetBits(s_events, EPD_WORKER_BIT_IDLE);
+    if (xTaskCreate(epd_worker_task, "epd_worker", EPD_WORKER_STACK, NULL,
+                    EPD_WORKER_PRIORITY, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start EPD worker");
+        s_task = NULL;
+    }
+}
+
+static epd_show_result_t queue_frame(const uint8_t *held, epd_frame_format_t format,
+                                     epd_frame_done_cb_t cb, void *ctx)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    epd_frame_done_cb_t dropped_cb = s_has_pending ? s_pending_cb : NULL;
+    void *dropped_ctx = s_pending_ctx;
+    bool dropped = s_has_pending;
+    const uint8_t *dropped_frame = s_has_pending ? s_pending : NULL;
+    s_pending = held;
+    s_pending_format = format;
+    s_pending_cb = cb;
+    s_pending_ctx = ctx;
+    s_has_pending = true;
+    xEventGroupClearBits(s_events, EPD_WORKER_BIT_IDLE);
+    xEventGroupSetBits(s_events, EPD_WORKER_BIT_BUSY);
+    xSemaphoreGive(s_lock);
+
+    if (dropped) {
+        frame_pool_release(dropped_frame);
+        ESP_LOGI(TAG, "Replaced a queued frame with a newer one");
+        notify_done(dropped_cb, dropped_ctx, EPD_SHOW_SUPERSEDED);
+    }
+    xTaskNotifyGive(s_task);
+    return EPD_SHOW_QUEUED;
+}
+
+epd_show_result_t epd_submit_frame(const uint8_t *frame, size_t length, epd_frame_format_t format,
+                                   epd_frame_done_cb_t cb, void *ctx)
+{
+    if (!frame || length != EPD_FRAME_BYTES) {
+        return EPD_SHOW_INVALID;
+    }
+    if (!s_task) {
+        // No worker (e.g. it failed to start): fall back to a blocking refresh.
+        epd_show_result_t result = show_frame(frame, format);
+        notify_done(cb, ctx, result);
+        return result;
+    }
+
+    // Pool buffers are handed over by reference; anything else is copied into
+    // one.
+    const uint8_t *held = frame;
+    if (frame_pool_owns(frame)) {
+        frame_pool_retain(frame);
+    } else {
+        uint8_t *buf = frame_pool_acquire(EPD_WORKER_ACQUIRE_TIMEOUT_MS);
+        if (!buf) {
+            ESP_LOGW(TAG, "No free frame buffer");
+            notify_done(cb, ctx, EPD_SHOW_BUSY);
+            return EPD_SHOW_BUSY;
+        }
+        memcpy(buf, frame, EPD_FRAME_BYTES);
+        held = buf;
+    }
+    return queue_frame(held, format, cb, ctx);
+}
+
+epd_show_result_t epd_submit_borrowed(const uint8_t *frame, size_t length,
+                                      epd_frame_format_t format, epd_frame_done_cb_t cb, void *ctx)
+{
+    if (!frame || length != EPD_FRAME_BYTES) {
+        return EPD_SHOW_INVALID;
+    }
+    if (!s_task) {
+        epd_show_result_t result = show_frame(frame, format);
+        notify_done(cb, ctx, result);
+        return result;
+    }
+    return queue_frame(frame, format, cb, ctx);
+}
+
+epd_show_result_t epd_submit_image(const uint8_t *frame, size_t length, epd_frame_format_t format)
+{
+    return epd_submit_frame(frame, length, format, NULL, NULL);
+}
+
+epd_show_result_t epd_submit_source(epd_plane_source_t source, void *ctx, epd_frame_done_cb_t cb,
+                                    void *cb_ctx)
+{
+    if (!source) {
+        return EPD_SHOW_INVALID;
+    }
+    // The producer runs on the caller's task, so a source can never fall back
+    // to a blocking refresh here.
+    if (!s_task) {
+        return EPD_SHOW_BUSY;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_source) {
+        xSemaphoreGive(s_lock);
+        return EPD_SHOW_BUSY;
+    }
+    s_source = source;
+    s_source_ctx = ctx;
+    s_source_cb = cb;
+    s_source_cb_ctx = cb_ctx;
+    xEventGroupClearBits(s_events, EPD_WORKER_BIT_IDLE);
+    xEventGroupSetBits(s_events, EPD_WORKER_BIT_BUSY);
+    xSemaphoreGive(s_lock);
+
+    xTaskNotifyGive(s_task);
+    return EPD_SHOW_QUEUED;
+}
+
+EventGroupHandle_t epd_worker_events(void)
+{
+    return s_events;
+}
+
+bool epd_worker_wait_idle(uint32_t timeout_ms)
+{
+    if (!s_events) {
+        return true;
+    }
+    EventBits_t bits = xEventGroupWaitBits(s_events, EPD_WORKER_BIT_IDLE, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(timeout_ms));
+    return (bits & EPD_WORKER_BIT_IDLE) != 0;
+}
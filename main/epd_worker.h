@@ -0,0 +1,44 @@
+#ifndef EPD_WORKER_H
+#define EPD_WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#include "epd_169inch.h"
+
+#define EPD_WORKER_BIT_IDLE BIT0
+#define EPD_WORKER_BIT_BUSY BIT1
+// Set after every finished frame; cleared by whoever waits on it.
+#define EPD_WORKER_BIT_DONE BIT2
+
+typedef void (*epd_frame_done_cb_t)(epd_show_result_t result, void *ctx);
+// Called around each refresh; begin returns false if the panel must not be driven.
+typedef bool (*epd_power_begin_t)(uint32_t timeout_ms);
+typedef void (*epd_power_end_t)(void);
+
+void epd_worker_start(epd_power_begin_t power_begin, epd_power_end_t power_end);
+// Puts the frame into the single-slot mailbox and returns at once. A frame in
+// a frame pool buffer is retained rather than copied, so the caller may
+// release its own reference right away but must not write to it again. A
+// frame still waiting in the mailbox is replaced and its callback gets
+// EPD_SHOW_SUPERSEDED.
+epd_show_result_t epd_submit_frame(const uint8_t *frame, size_t length, epd_frame_format_t format,
+                                   epd_frame_done_cb_t cb, void *ctx);
+// Like epd_submit_frame but never copies: the frame (e.g. mapped from flash)
+// must stay valid until cb runs, with the result or EPD_SHOW_SUPERSEDED.
+epd_show_result_t epd_submit_borrowed(const uint8_t *frame, size_t length,
+                                      epd_frame_format_t format, epd_frame_done_cb_t cb, void *ctx);
+// epd_submit_frame without a callback, usable as an image_upload handler.
+epd_show_result_t epd_submit_image(const uint8_t *frame, size_t length, epd_frame_format_t format);
+// Queues a refresh fed by a plane source, ahead of any mailbox frame. Only one
+// source job can be outstanding; a second one gets EPD_SHOW_BUSY.
+epd_show_result_t epd_submit_source(epd_plane_source_t source, void *ctx, epd_frame_done_cb_t cb,
+                                    void *cb_ctx);
+EventGroupHandle_t epd_worker_events(void);
+bool epd_worker_wait_idle(uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,147 @@
+#include "frame_pool.h"
+
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "config.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "frame_pool";
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_free;
+static uint8_t *s_buffers[FRAME_POOL_BUFFERS];
+static uint8_t s_refs[FRAME_POOL_BUFFERS];
+static uint32_t s_in_use;
+static uint32_t s_high_water;
+static uint32_t s_acquire_failures;
+
+static uint8_t *alloc_frame(void)
+{
+    uint8_t *buf = heap_caps_malloc(FRAME_POOL_BUFFER_BYTES, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+    if (!buf) {
+        buf = malloc(FRAME_POOL_BUFFER_BYTES);
+    }
+    return buf;
+}
+
+static int buffer_index(const void *ptr)
+{
+    const uint8_t *p = ptr;
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        if (s_buffers[i] && p >= s_buffers[i] && p < s_buffers[i] + FRAME_POOL_BUFFER_BYTES) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A partly allocated pool is given back, so a later init starts clean.
+static void free_buffers(void)
+{
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        free(s_buffers[i]);
+        s_buffers[i] = NULL;
+    }
+}
+
+bool frame_pool_init(void)
+{
+    if (s_free) {
+        return true;
+    }
+
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        s_buffers[i] = alloc_frame();
+        if (!s_buffers[i]) {
+            ESP_LOGE(TAG, "Failed to allocate frame buffer %d", i);
+            free_buffers();
+            return false;
+        }
+    }
+    s_free = xSemaphoreCreateCounting(FRAME_POOL_BUFFERS, FRAME_POOL_BUFFERS);
+    if (!s_free) {
+        ESP_LOGE(TAG, "Failed to create frame pool");
+        free_buffers();
+        return false;
+    }
+    ESP_LOGI(TAG, "%d frame buffers of %u bytes", FRAME_POOL_BUFFERS,
+             (unsigned)FRAME_POOL_BUFFER_BYTES);
+    return true;
+}
+
+uint8_t *frame_pool_acquire(uint32_t timeout_ms)
+{
+    if (!s_free || xSemaphoreTake(s_free, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        portENTER_CRITICAL(&s_lock);
+        s_acquire_failures++;
+        portEXIT_CRITICAL(&s_lock);
+        return NULL;
+    }
+
+    uint8_t *buf = NULL;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        if (s_refs[i] == 0) {
+            s_refs[i] = 1;
+            buf = s_buffers[i];
+            break;
+        }
+    }
+    s_in_use++;
+    if (s_in_use > s_high_water) {
+        s_high_water = s_in_use;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return buf;
+}
+
+bool frame_pool_owns(const void *ptr)
+{
+    return ptr && buffer_index(ptr) >= 0;
+}
+
+void frame_pool_retain(const void *ptr)
+{
+    int i = buffer_index(ptr);
+    if (i < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_refs[i]++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void frame_pool_release(const void *ptr)
+{
+    int i = ptr ? buffer_index(ptr) : -1;
+    if (i < 0) {
+        return;
+    }
+
+    bool freed = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_refs[i] > 0) {
+        s_refs[i]--;
+        if (s_refs[i] == 0) {
+            s_in_use--;
+            freed = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (freed) {
+        xSemaphoreGive(s_free);
+    }
+}
+
+void frame_pool_get_stats(frame_pool_stats_t *out)
+{
+    portENTER_CRITICAL(&s_lock);
+    out->buffers = FRAME_POOL_BUFFERS;
+    out->in_use = s_in_use;
+    out->high_water = s_high_water;
+    out->acquire_failures = s_acquire_failures;
+    portEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,33 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "epd_169inch.h"
+
+// Every buffer fits an SP6N container, so an upload can decode in place.
+#define FRAME_POOL_BUFFER_BYTES (EPD_SP6N_HEADER_BYTES + EPD_FRAME_BYTES)
+
+typedef struct {
+    uint32_t buffers;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t acquire_failures;
+} frame_pool_stats_t;
+
+// Allocates the FRAME_POOL_BUFFERS buffers once; they are never freed. On
+// failure nothing stays allocated and acquire returns NULL, so callers that
+// need a copy fail while borrowed frames and sources keep working.
+bool frame_pool_init(void);
+// Returns a buffer holding one reference, or NULL after timeout_ms.
+uint8_t *frame_pool_acquire(uint32_t timeout_ms);
+// ptr may point anywhere inside a pool buffer, e.g. past an SP6N header.
+bool frame_pool_owns(const void *ptr);
+// Adds a reference for a new owner; each owner releases its own.
+void frame_pool_retain(const void *ptr);
+void frame_pool_release(const void *ptr);
+void frame_pool_get_stats(frame_pool_stats_t *out);
+
+#endif
@@ -0,0 +1,299 @@
+#include "frame_store.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "frame_pool.h"
+
+#define FRAME_STORE_LABEL "frames"
+#define FRAME_STORE_MAGIC 0x544C5346U
+#define FRAME_STORE_VERSION 1U
+#define FRAME_STORE_SECTOR 4096U
+#define FRAME_STORE_HEADER_BYTES 32U
+#define FRAME_STORE_SLOT_BYTES                                                                   \
+    (((FRAME_STORE_HEADER_BYTES + EPD_FRAME_BYTES) + FRAME_STORE_SECTOR - 1U) &                 \
+     ~(FRAME_STORE_SECTOR - 1U))
+// Header format of a slot that only records "nothing stored is on the panel".
+#define FRAME_STORE_FORMAT_NONE 0xFFU
+#define FRAME_STORE_TASK_STACK 3072
+#define FRAME_STORE_TASK_PRIORITY 2
+#define FRAME_STORE_ACQUIRE_TIMEOUT_MS 1000
+
+static const char *TAG = "frame_store";
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t format;
+    uint8_t reserved0;
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint32_t frame_crc;
+    uint8_t reserved[8];
+    uint32_t header_crc;
+} frame_slot_header_t;
+
+_Static_assert(sizeof(frame_slot_header_t) == FRAME_STORE_HEADER_BYTES, "slot header size");
+
+static const esp_partition_t *s_part;
+static uint32_t s_slots;
+static int s_latest = -1;
+static uint32_t s_sequence;
+static frame_slot_header_t s_latest_header;
+
+static TaskHandle_t s_task;
+static SemaphoreHandle_t s_lock;
+static bool s_has_pending;
+static const uint8_t *s_pending;
+static epd_frame_format_t s_pending_format;
+// The save the task is writing stays readable until its slot is the latest.
+static bool s_has_writing;
+static const uint8_t *s_writing;
+static epd_frame_format_t s_writing_format;
+
+static uint32_t header_checksum(const frame_slot_header_t *h)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)h, offsetof(frame_slot_header_t, header_crc));
+}
+
+static bool read_header(uint32_t slot, frame_slot_header_t *h)
+{
+    if (esp_partition_read(s_part, slot * FRAME_STORE_SLOT_BYTES, h, sizeof(*h)) != ESP_OK) {
+        return false;
+    }
+    return h->magic == FRAME_STORE_MAGIC && h->version == FRAME_STORE_VERSION &&
+           h->header_crc == header_checksum(h);
+}
+
+static bool write_slot(const uint8_t *frame, epd_frame_format_t format)
+{
+    uint32_t slot = s_latest < 0 ? 0U : ((uint32_t)s_latest + 1U) % s_slots;
+    size_t base = slot * FRAME_STORE_SLOT_BYTES;
+
+    frame_slot_header_t h = {
+        .magic = FRAME_STORE_MAGIC,
+        .version = FRAME_STORE_VERSION,
+        .format = frame ? (uint8_t)format : FRAME_STORE_FORMAT_NONE,
+        .sequence = s_sequence + 1U,
+        .timestamp = (uint32_t)time(NULL),
+        .frame_crc = frame ? esp_rom_crc32_le(0, frame, EPD_FRAME_BYTES) : 0U,
+    };
+    h.header_crc = header_checksum(&h);
+
+    // A tombstone only needs its header sector.
+    esp_err_t err = esp_partition_erase_range(s_part, base,
+                                              frame ? FRAME_STORE_SLOT_BYTES : FRAME_STORE_SECTOR);
+    if (err == ESP_OK && frame) {
+        err = esp_partition_write(s_part, base + FRAME_STORE_HEADER_BYTES, frame, EPD_FRAME_BYTES);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_part, base, &h, sizeof(h));
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Slot %u write failed: %s", (unsigned)slot, esp_err_to_name(err));
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_latest = (int)slot;
+    s_sequence = h.sequence;
+    s_latest_header = h;
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Stored %s in slot %u (sequence %u)", frame ? "frame" : "tombstone",
+             (unsigned)slot, (unsigned)h.sequence);
+    return true;
+}
+
+static void frame_store_task(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool has = s_has_pending;
+        const uint8_t *frame = s_pending;
+        epd_frame_format_t format = s_pending_format;
+        s_has_pending = false;
+        s_pending = NULL;
+        s_has_writing = has;
+        s_writing = frame;
+        s_writing_format = format;
+        xSemaphoreGive(s_lock);
+
+        if (has) {
+            write_slot(frame, format);
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_has_writing = false;
+            s_writing = NULL;
+            xSemaphoreGive(s_lock);
+            frame_pool_release(frame);
+        }
+    }
+}
+
+bool frame_store_init(void)
+{
+    if (s_task) {
+        return true;
+    }
+
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                      FRAME_STORE_LABEL);
+    if (!s_part) {
+        ESP_LOGW(TAG, "No \"%s\" partition, frames are not persisted", FRAME_STORE_LABEL);
+        return false;
+    }
+    s_slots = s_part->size / FRAME_STORE_SLOT_BYTES;
+    if (s_slots == 0) {
+        ESP_LOGW(TAG, "Partition too small for a frame slot");
+        s_part = NULL;
+        return false;
+    }
+
+    for (uint32_t slot = 0; slot < s_slots; slot++) {
+        frame_slot_header_t h;
+        if (read_header(slot, &h) && (s_latest < 0 || (int32_t)(h.sequence - s_sequence) > 0)) {
+            s_latest = (int)slot;
+            s_sequence = h.sequence;
+            s_latest_header = h;
+        }
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock || xTaskCreate(frame_store_task, "frame_store", FRAME_STORE_TASK_STACK, NULL,
+                               FRAME_STORE_TASK_PRIORITY, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start frame store");
+        s_task = NULL;
+        s_part = NULL;
+        return false;
+    }
+    ESP_LOGI(TAG, "%u slots, latest %d (sequence %u)", (unsigned)s_slots, s_latest,
+             (unsigned)s_sequence);
+    return true;
+}
+
+static void queue_save(const uint8_t *held, epd_frame_format_t format)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const uint8_t *dropped = s_has_pending ? s_pending : NULL;
+    s_pending = held;
+    s_pending_format = format;
+    s_has_pending = true;
+    xSemaphoreGive(s_lock);
+
+    frame_pool_release(dropped);
+    xTaskNotifyGive(s_task);
+}
+
+bool frame_store_save(const uint8_t *frame, epd_frame_format_t format)
+{
+    if (!s_task || !frame) {
+        return false;
+    }
+
+    const uint8_t *held = frame;
+    if (frame_pool_owns(frame)) {
+        frame_pool_retain(frame);
+    } else {
+        uint8_t *buf = frame_pool_acquire(FRAME_STORE_ACQUIRE_TIMEOUT_MS);
+        if (!buf) {
+            ESP_LOGW(TAG, "No free frame buffer, frame not stored");
+            return false;
+        }
+        memcpy(buf, frame, EPD_FRAME_BYTES);
+        held = buf;
+    }
+    queue_save(held, format);
+    return true;
+}
+
+void frame_store_invalidate(void)
+{
+    if (s_task) {
+        queue_save(NULL, EPD_FRAME_SP6);
+    }
+}
+
+bool frame_store_map_latest(frame_store_map_t *map)
+{
+    if (!s_part || !map) {
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int slot = s_latest;
+    frame_slot_header_t h = s_latest_header;
+    xSemaphoreGive(s_lock);
+    if (slot < 0 || h.format == FRAME_STORE_FORMAT_NONE) {
+        return false;
+    }
+
+    const void *ptr = NULL;
+    esp_err_t err = esp_partition_mmap(s_part, (size_t)slot * FRAME_STORE_SLOT_BYTES + FRAME_STORE_HEADER_BYTES,
+                                       EPD_FRAME_BYTES, ESP_PARTITION_MMAP_DATA, &ptr, &map->handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "mmap failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    if (esp_rom_crc32_le(0, ptr, EPD_FRAME_BYTES) != h.frame_crc) {
+        ESP_LOGW(TAG, "Slot %d frame is corrupt", slot);
+        esp_partition_munmap(map->handle);
+        return false;
+    }
+    map->frame = ptr;
+    map->format = (epd_frame_format_t)h.format;
+    map->timestamp = h.timestamp;
+    return true;
+}
+
+bool frame_store_read_latest(uint8_t *out, epd_frame_format_t *format, uint32_t *crc)
+{
+    if (!s_part || !out) {
+        return false;
+    }
+
+    // A save still queued or being written is newer than anything in flash.
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_has_pending || s_has_writing) {
+        const uint8_t *held = s_has_pending ? s_pending : s_writing;
+        epd_frame_format_t held_format = s_has_pending ? s_pending_format : s_writing_format;
+        if (held) {
+            frame_pool_retain(held);
+        }
+        xSemaphoreGive(s_lock);
+        if (!held) {
+            return false;
+        }
+        memcpy(out, held, EPD_FRAME_BYTES);
+        frame_pool_release(held);
+        *format = held_format;
+        *crc = esp_rom_crc32_le(0, out, EPD_FRAME_BYTES);
+        return true;
+    }
+    xSemaphoreGive(s_lock);
+
+    frame_store_map_t map;
+    if (!frame_store_map_latest(&map)) {
+        return false;
+    }
+    memcpy(out, map.frame, EPD_FRAME_BYTES);
+    frame_store_unmap(&map);
+    *format = map.format;
+    *crc = esp_rom_crc32_le(0, out, EPD_FRAME_BYTES);
+    return true;
+}
+
+void frame_store_unmap(frame_store_map_t *map)
+{
+    if (map && map->frame) {
+        esp_partition_munmap(map->handle);
+        map->frame = NULL;
+    }
+}
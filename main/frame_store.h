@@ -0,0 +1,40 @@
+#ifndef FRAME_STORE_H
+#define FRAME_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+#include "epd_169inch.h"
+
+// Last-frame persistence in the raw "frames" partition: fixed-size slots, each
+// a small header followed by the frame bytes. Every save goes to the next slot
+// in turn to spread the erases, and the header is written last so a torn write
+// is never picked up.
+
+typedef struct {
+    const uint8_t *frame;
+    epd_frame_format_t format;
+    uint32_t timestamp;
+    esp_partition_mmap_handle_t handle;
+} frame_store_map_t;
+
+// Finds the partition, scans the slot headers and starts the writer task.
+bool frame_store_init(void);
+// Queues the frame for writing and returns at once. A frame pool buffer is
+// retained until written, anything else is copied into one. A save still
+// waiting is replaced by the newer one.
+bool frame_store_save(const uint8_t *frame, epd_frame_format_t format);
+// Records that the panel no longer shows any stored frame.
+void frame_store_invalidate(void);
+// Maps the newest stored frame straight from flash; the driver reads it from
+// there without a RAM copy. Undo with frame_store_unmap.
+bool frame_store_map_latest(frame_store_map_t *map);
+void frame_store_unmap(frame_store_map_t *map);
+// Copies the newest frame, including one still waiting to be written, and
+// returns its CRC32.
+bool frame_store_read_latest(uint8_t *out, epd_frame_format_t *format, uint32_t *crc);
+
+#endif
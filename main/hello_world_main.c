@@ -14,6 +14,9 @@
 #include "freertos/task.h"
 
 #include "epd_169inch.h"
+#include "epd_worker.h"
+#include "frame_pool.h"
+#include "frame_store.h"
 #include "image_upload.h"
 #include "led_ws2812.h"
 #include "scd30_app.h"
@@ -26,6 +29,31 @@ static void on_status(image_upload_status_t status, void *ctx)
     s_led_status = status;
 }
 
+static frame_store_map_t s_boot_frame;
+
+static void boot_frame_done(epd_show_result_t result, void *ctx)
+{
+    (void)ctx;
+    printf("Stored frame restore finished (result %d)\n", (int)result);
+    frame_store_unmap(&s_boot_frame);
+}
+
+// Puts the stored frame back on the panel without waiting for the network:
+// nothing happens if the panel still shows it, otherwise the worker refreshes
+// from the flash mapping while Wi-Fi comes up.
+static void restore_stored_frame(void)
+{
+    if (!frame_store_map_latest(&s_boot_frame)) {
+        return;
+    }
+    if (epd_restore_displayed_frame(s_boot_frame.frame, EPD_FRAME_BYTES, s_boot_frame.format)) {
+        frame_store_unmap(&s_boot_frame);
+        return;
+    }
+    epd_submit_borrowed(s_boot_frame.frame, EPD_FRAME_BYTES, s_boot_frame.format,
+                        boot_frame_done, NULL);
+}
+
 static void set_led(ws2812_strip_t *strip, uint8_t r, uint8_t g, uint8_t b)
 {
     ws2812_set_pixel(strip, 0, r, g, b);
@@ -118,9 +146,13 @@ void app_main(void)
 
     printf("Minimum free heap size: %" PRIu32 " bytes\n", esp_get_minimum_free_heap_size());
 
+    frame_pool_init();
+    frame_store_init();
     epd_setup();
+    epd_worker_start(scd30_display_begin, scd30_display_end);
+    restore_stored_frame();
     xTaskCreate(led_task, "led_task", 2048, NULL, 5, NULL);
     image_upload_set_status_callback(on_status, NULL);
     scd30_app_start();
-    image_upload_start(epd_show_image, 400U * 400U / 2U);
+    image_upload_start(epd_submit_image, 400U * 400U / 2U);
 }
@@ -13,10 +13,14 @@
 #include "esp_spiffs.h"
 #include "esp_timer.h"
 #include "esp_wifi.h"
-#include "esp_heap_caps.h"
-#include "heatshrink_decoder.h"
 #include "config.h"
+#include "epd_169inch_bus.h"
+#include "epd_stats.h"
+#include "epd_stream.h"
+#include "frame_pool.h"
+#include "frame_store.h"
 #include "scd30_app.h"
+#include "upload_decoder.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -29,18 +33,28 @@ static const char *TAG = "image_upload";
 #define WIFI_MAXIMUM_RETRY 10
 #define WIFI_RETRY_DELAY_MS 5000
 
-#define RLE_MAGIC_0 0x53
-#define RLE_MAGIC_1 0x50
-#define RLE_MAGIC_2 0x36
-#define RLE_MAGIC_3 0x52
-#define RLE_HEADER_SIZE 8
-
-#define HS_MAGIC_0 0x48
-#define HS_MAGIC_1 0x53
-#define HS_MAGIC_2 0x4B
-#define HS_MAGIC_3 0x31
-#define HS_HEADER_SIZE 10
-#define HS_INPUT_BUFFER_SIZE 256
+// SP6D tile delta: "SP6D", u32 CRC32 of the base frame, u8 frame format,
+// u8 tile width in bytes, u8 tile rows, u8 reserved, u16 tile count, then per
+// tile a u16 index and its bytes row by row. The frame is cut as a byte grid
+// of 200-byte rows, so an SP6 tile is 16x16 pixels.
+#define DELTA_MAGIC_0 0x53
+#define DELTA_MAGIC_1 0x50
+#define DELTA_MAGIC_2 0x36
+#define DELTA_MAGIC_3 0x44
+#define DELTA_HEADER_SIZE 14
+#define DELTA_ROW_BYTES 200U
+#define DELTA_TILE_W_BYTES 8U
+#define DELTA_TILE_ROWS 16U
+#define DELTA_TILE_BYTES (DELTA_TILE_W_BYTES * DELTA_TILE_ROWS)
+#define DELTA_RECORD_SIZE (2U + DELTA_TILE_BYTES)
+#define DELTA_TILES_X (DELTA_ROW_BYTES / DELTA_TILE_W_BYTES)
+#define DELTA_TILES_Y (EPD_FRAME_BYTES / DELTA_ROW_BYTES / DELTA_TILE_ROWS)
+
+#define UPLOAD_RECV_WINDOW 1024
+#define UPLOAD_STREAM_STAGING 512
+#define UPLOAD_BUFFER_TIMEOUT_MS 5000
+// Consecutive receive timeouts before a stalled client is dropped.
+#define UPLOAD_RECV_TIMEOUT_RETRIES 3
 
 static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_num;
@@ -64,136 +78,10 @@ static void notify_status(image_upload_status_t status)
     }
 }
 
-static void *alloc_upload_buffer(size_t size)
-{
-    void *buf = heap_caps_malloc(size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-    if (!buf) {
-        buf = malloc(size);
-    }
-    return buf;
-}
-
-static bool decode_rle_sp6_nibbles(const uint8_t *input, size_t input_len,
-                                   uint8_t *output, size_t output_len)
-{
-    if (input_len < RLE_HEADER_SIZE) {
-        return false;
-    }
-
-    size_t pos = RLE_HEADER_SIZE;
-    size_t nibble_index = 0;
-    size_t nibble_total = output_len * 2U;
-
-    while (pos + 1 < input_len && nibble_index < nibble_total) {
-        uint8_t run_len = input[pos];
-        uint8_t value = input[pos + 1] & 0x0F;
-        pos += 2;
-
-        if (run_len == 0) {
-            return false;
-        }
-
-        for (uint8_t i = 0; i < run_len; i++) {
-            if (nibble_index >= nibble_total) {
-                return false;
-            }
-            size_t byte_index = nibble_index / 2U;
-            if ((nibble_index & 1U) == 0U) {
-                output[byte_index] = (uint8_t)(value << 4);
-            } else {
-                output[byte_index] |= value;
-            }
-            nibble_index++;
-        }
-    }
-
-    return nibble_index == nibble_total;
-}
-
-static bool decode_heatshrink(const uint8_t *input, size_t input_len,
-                              uint8_t *output, size_t output_len)
+static uint32_t read_u32_le(const uint8_t *p)
 {
-    if (input_len < HS_HEADER_SIZE) {
-        return false;
-    }
-
-    uint8_t window_bits = input[8];
-    uint8_t lookahead_bits = input[9];
-    heatshrink_decoder *decoder = heatshrink_decoder_alloc(
-        HS_INPUT_BUFFER_SIZE, window_bits, lookahead_bits);
-    if (!decoder) {
-        return false;
-    }
-
-    size_t input_pos = HS_HEADER_SIZE;
-    size_t output_pos = 0;
-
-    while (input_pos < input_len) {
-        size_t sunk = 0;
-        HSD_sink_res sink_res = heatshrink_decoder_sink(
-            decoder, (uint8_t *)input + input_pos, input_len - input_pos, &sunk);
-        input_pos += sunk;
-        if (sink_res < 0) {
-            heatshrink_decoder_free(decoder);
-            return false;
-        }
-
-        while (1) {
-            size_t polled = 0;
-            if (output_pos >= output_len) {
-                heatshrink_decoder_free(decoder);
-                return false;
-            }
-            HSD_poll_res poll_res = heatshrink_decoder_poll(
-                decoder, output + output_pos, output_len - output_pos, &polled);
-            output_pos += polled;
-            if (poll_res == HSDR_POLL_MORE) {
-                continue;
-            }
-            if (poll_res == HSDR_POLL_EMPTY) {
-                break;
-            }
-            if (poll_res < 0) {
-                heatshrink_decoder_free(decoder);
-                return false;
-            }
-        }
-    }
-
-    while (1) {
-        HSD_finish_res finish_res = heatshrink_decoder_finish(decoder);
-        if (finish_res == HSDR_FINISH_DONE) {
-            break;
-        }
-        if (finish_res < 0) {
-            heatshrink_decoder_free(decoder);
-            return false;
-        }
-
-        while (1) {
-            size_t polled = 0;
-            if (output_pos >= output_len) {
-                heatshrink_decoder_free(decoder);
-                return false;
-            }
-            HSD_poll_res poll_res = heatshrink_decoder_poll(
-                decoder, output + output_pos, output_len - output_pos, &polled);
-            output_pos += polled;
-            if (poll_res == HSDR_POLL_MORE) {
-                continue;
-            }
-            if (poll_res == HSDR_POLL_EMPTY) {
-                break;
-            }
-            if (poll_res < 0) {
-                heatshrink_decoder_free(decoder);
-                return false;
-            }
-        }
-    }
-
-    heatshrink_decoder_free(decoder);
-    return output_pos == output_len;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
 }
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id,
@@ -594,6 +482,153 @@ static esp_err_t handle_scd30_history_get(httpd_req_t *req)
     return ESP_OK;
 }
 
+static const char *epd_target_name(uint8_t target)
+{
+    switch (target) {
+        case EPD_MASTER_ONLY:
+            return "master";
+        case EPD_SLAVE_ONLY:
+            return "slave";
+        default:
+            return "both";
+    }
+}
+
+static esp_err_t handle_epd_metrics_get(httpd_req_t *req)
+{
+    epd_bus_metrics_t metrics;
+    epd_bus_trace_entry_t entries[EPD_BUS_TRACE_DEPTH];
+    size_t count = epd_bus_get_metrics(&metrics, entries, EPD_BUS_TRACE_DEPTH);
+
+    httpd_resp_set_type(req, "application/json");
+
+    char item[224];
+    int len = snprintf(item, sizeof(item),
+                       "{\"commands\":%u,\"resets\":%u,\"busy_waits\":%u,"
+                       "\"busy_timeouts\":%u,\"trace_total\":%u,\"data_bytes\":%llu,"
+                       "\"read_bytes\":%llu,\"spi_us\":%llu,\"busy_us\":%llu,\"opcodes\":[",
+                       (unsigned)metrics.commands, (unsigned)metrics.resets,
+                       (unsigned)metrics.busy_waits, (unsigned)metrics.busy_timeouts,
+                       (unsigned)metrics.trace_total,
+                       (unsigned long long)metrics.data_bytes,
+                       (unsigned long long)metrics.read_bytes,
+                       (unsigned long long)metrics.spi_us,
+                       (unsigned long long)metrics.busy_us);
+    if (len < 0) {
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_FAIL;
+    }
+    httpd_resp_sendstr_chunk(req, item);
+
+    for (size_t i = 0; i < metrics.opcode_count; i++) {
+        const epd_bus_opcode_stats_t *op = &metrics.opcodes[i];
+        len = snprintf(item, sizeof(item),
+                       "%s{\"op\":\"0x%02X\",\"count\":%u,\"data_bytes\":%u,"
+                       "\"read_bytes\":%u,\"spi_us\":%llu,\"busy_us\":%llu}",
+                       (i == 0) ? "" : ",", op->opcode, (unsigned)op->count,
+                       (unsigned)op->data_bytes, (unsigned)op->read_bytes,
+                       (unsigned long long)op->spi_us, (unsigned long long)op->busy_us);
+        if (len < 0) {
+            httpd_resp_sendstr_chunk(req, NULL);
+            return ESP_FAIL;
+        }
+        httpd_resp_sendstr_chunk(req, item);
+    }
+
+    httpd_resp_sendstr_chunk(req, "],\"trace\":[");
+    for (size_t i = 0; i < count; i++) {
+        const epd_bus_trace_entry_t *e = &entries[i];
+        len = snprintf(item, sizeof(item),
+                       "%s{\"t_ms\":%u,\"op\":\"0x%02X\",\"target\":\"%s\",\"data\":%u,"
+                       "\"read\":%u,\"spi_us\":%u,\"busy_us\":%u,\"timeout\":%s}",
+                       (i == 0) ? "" : ",", (unsigned)e->start_ms, e->opcode,
+                       epd_target_name(e->target), (unsigned)e->data_bytes,
+                       (unsigned)e->read_bytes, (unsigned)e->spi_us, (unsigned)e->busy_us,
+                       e->busy_timeout ? "true" : "false");
+        if (len < 0) {
+            httpd_resp_sendstr_chunk(req, NULL);
+            return ESP_FAIL;
+        }
+        httpd_resp_sendstr_chunk(req, item);
+    }
+
+    httpd_resp_sendstr_chunk(req, "]}");
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t handle_epd_stats_get(httpd_req_t *req)
+{
+    epd_stats_t stats;
+    epd_stats_get(&stats);
+
+    httpd_resp_set_type(req, "application/json");
+
+    char item[224];
+    int len;
+    if (stats.temperature_valid) {
+        len = snprintf(item, sizeof(item), "{\"frames\":%u,\"temperature_c\":%d,\"phases\":{",
+                       (unsigned)stats.frames, (int)stats.temperature);
+    } else {
+        len = snprintf(item, sizeof(item), "{\"frames\":%u,\"temperature_c\":null,\"phases\":{",
+                       (unsigned)stats.frames);
+    }
+    if (len < 0) {
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_FAIL;
+    }
+    httpd_resp_sendstr_chunk(req, item);
+
+    for (int p = 0; p < EPD_PHASE_COUNT; p++) {
+        const epd_phase_hist_t *h = &stats.phases[p];
+        len = snprintf(item, sizeof(item),
+                       "%s\"%s\":{\"count\":%u,\"min_us\":%u,\"max_us\":%u,\"mean_us\":%u,"
+                       "\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"buckets\":[",
+                       (p == 0) ? "" : ",", epd_stats_phase_name((epd_phase_t)p),
+                       (unsigned)h->count, (unsigned)h->min_us, (unsigned)h->max_us,
+                       h->count ? (unsigned)(h->sum_us / h->count) : 0U,
+                       (unsigned)epd_stats_percentile(h, 50),
+                       (unsigned)epd_stats_percentile(h, 90),
+                       (unsigned)epd_stats_percentile(h, 99));
+        if (len < 0) {
+            httpd_resp_sendstr_chunk(req, NULL);
+            return ESP_FAIL;
+        }
+        httpd_resp_sendstr_chunk(req, item);
+
+        // Only occupied buckets, as [lower bound in us, count].
+        bool first = true;
+        for (size_t b = 0; b < EPD_STATS_BUCKETS; b++) {
+            uint32_t lower;
+            uint32_t upper;
+            if (h->buckets[b] == 0) {
+                continue;
+            }
+            epd_stats_bucket_range(b, &lower, &upper);
+            len = snprintf(item, sizeof(item), "%s[%u,%u]", first ? "" : ",",
+                           (unsigned)lower, (unsigned)h->buckets[b]);
+            if (len < 0) {
+                httpd_resp_sendstr_chunk(req, NULL);
+                return ESP_FAIL;
+            }
+            httpd_resp_sendstr_chunk(req, item);
+            first = false;
+        }
+        httpd_resp_sendstr_chunk(req, "]}");
+    }
+
+    frame_pool_stats_t pool;
+    frame_pool_get_stats(&pool);
+    snprintf(item, sizeof(item),
+             "},\"frame_pool\":{\"buffers\":%u,\"in_use\":%u,\"high_water\":%u,"
+             "\"acquire_failures\":%u}}",
+             (unsigned)pool.buffers, (unsigned)pool.in_use, (unsigned)pool.high_water,
+             (unsigned)pool.acquire_failures);
+    httpd_resp_sendstr_chunk(req, item);
+    httpd_resp_sendstr_chunk(req, NULL);
+    return ESP_OK;
+}
+
 static esp_err_t handle_scd30_render_post(httpd_req_t *req)
 {
     (void)req;
@@ -641,157 +676,356 @@ static esp_err_t handle_heatshrink_wasm(httpd_req_t *req)
     return send_spiffs_file(req, "/spiffs/heatshrink.wasm", "application/wasm");
 }
 
-static esp_err_t handle_image_post(httpd_req_t *req)
+static esp_err_t upload_fail(httpd_req_t *req, httpd_err_code_t code, const char *message)
 {
-    notify_status(IMAGE_UPLOAD_STATUS_UPLOADING);
-    if (req->content_len <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
-        notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-        return ESP_FAIL;
-    }
+    httpd_resp_send_err(req, code, message);
+    notify_status(IMAGE_UPLOAD_STATUS_IDLE);
+    return ESP_FAIL;
+}
 
-    size_t input_len = (size_t)req->content_len;
-    uint8_t *input = alloc_upload_buffer(input_len);
-    if (!input) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
-        notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-        return ESP_FAIL;
-    }
+typedef bool (*upload_feed_t)(void *ctx, const uint8_t *data, size_t len);
 
+// Feeds the request body to a parser in small windows. Returns false only
+// when the socket fails; a parse error stops early and is left to the caller.
+static bool upload_receive(httpd_req_t *req, upload_feed_t feed, void *ctx)
+{
+    uint8_t window[UPLOAD_RECV_WINDOW];
+    size_t input_len = (size_t)req->content_len;
     size_t received = 0;
+    int timeouts = 0;
     while (received < input_len) {
-        int chunk = httpd_req_recv(req, (char *)input + received, input_len - received);
+        size_t want = input_len - received;
+        int chunk = httpd_req_recv(req, (char *)window, want < sizeof(window) ? want : sizeof(window));
+        if (chunk == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < UPLOAD_RECV_TIMEOUT_RETRIES) {
+            continue;
+        }
         if (chunk <= 0) {
-            free(input);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Receive failed");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
+            ESP_LOGW(TAG, "Receive failed after %u of %u bytes", (unsigned)received,
+                     (unsigned)input_len);
+            return false;
         }
+        timeouts = 0;
         received += (size_t)chunk;
+        if (!feed(ctx, window, (size_t)chunk)) {
+            break;
+        }
     }
+    return true;
+}
 
-    const uint8_t *raw = input;
-    size_t raw_len = input_len;
-    uint8_t *decoded = NULL;
-
-    bool has_hs_header = input_len >= HS_HEADER_SIZE &&
-                         input[0] == HS_MAGIC_0 &&
-                         input[1] == HS_MAGIC_1 &&
-                         input[2] == HS_MAGIC_2 &&
-                         input[3] == HS_MAGIC_3;
-
-    bool has_rle_header = input_len >= RLE_HEADER_SIZE &&
-                          input[0] == RLE_MAGIC_0 &&
-                          input[1] == RLE_MAGIC_1 &&
-                          input[2] == RLE_MAGIC_2 &&
-                          input[3] == RLE_MAGIC_3;
-
-    if (has_hs_header) {
-        uint32_t decoded_size = (uint32_t)input[4] |
-                                ((uint32_t)input[5] << 8) |
-                                ((uint32_t)input[6] << 16) |
-                                ((uint32_t)input[7] << 24);
-        if (decoded_size != s_expected_size) {
-            free(input);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid heatshrink size");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+static bool decoder_feed(void *ctx, const uint8_t *data, size_t len)
+{
+    return upload_decoder_feed(ctx, data, len);
+}
 
-        decoded = alloc_upload_buffer(s_expected_size);
-        if (!decoded) {
-            free(input);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+// Shared tail of every buffered upload: skips frames already on the panel,
+// persists the rest and hands them to the display.
+static esp_err_t show_received_frame(httpd_req_t *req, const uint8_t *frame, epd_frame_format_t format)
+{
+    if (epd_frame_unchanged(frame, s_expected_size, format)) {
+        ESP_LOGI(TAG, "Image matches the displayed frame, nothing to do");
+        httpd_resp_sendstr(req, "UNCHANGED");
+        notify_status(IMAGE_UPLOAD_STATUS_IDLE);
+        return ESP_OK;
+    }
 
-        if (!decode_heatshrink(input, input_len, decoded, s_expected_size)) {
-            free(decoded);
-            free(input);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Heatshrink decode failed");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+    // Written to flash in the background; the frame store keeps its own
+    // reference to the buffer.
+    if (!frame_store_save(frame, format)) {
+        ESP_LOGW(TAG, "Frame not persisted");
+    }
 
-        raw = decoded;
-        raw_len = s_expected_size;
-        ESP_LOGI(TAG, "Image received (heatshrink %u bytes -> raw %u bytes, ratio %.2fx)",
-             (unsigned)input_len, (unsigned)raw_len,
-             raw_len ? ((double)input_len / (double)raw_len) : 0.0);
-    } else if (has_rle_header) {
-        uint32_t decoded_size = (uint32_t)input[4] |
-                                ((uint32_t)input[5] << 8) |
-                                ((uint32_t)input[6] << 16) |
-                                ((uint32_t)input[7] << 24);
-        if (decoded_size != s_expected_size) {
-            free(input);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid RLE size");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+    epd_show_result_t result = s_handler ? s_handler(frame, s_expected_size, format) : EPD_SHOW_OK;
 
-        decoded = alloc_upload_buffer(s_expected_size);
-        if (!decoded) {
-            free(input);
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+    if (result == EPD_SHOW_UNCHANGED) {
+        httpd_resp_sendstr(req, "UNCHANGED");
+    } else if (result == EPD_SHOW_QUEUED) {
+        httpd_resp_sendstr(req, "QUEUED");
+    } else {
+        httpd_resp_sendstr(req, "OK");
+    }
+    notify_status(IMAGE_UPLOAD_STATUS_IDLE);
+    return ESP_OK;
+}
 
-        if (!decode_rle_sp6_nibbles(input, input_len, decoded, s_expected_size)) {
-            free(decoded);
-            free(input);
-            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "RLE decode failed");
-            notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-            return ESP_FAIL;
-        }
+static esp_err_t receive_image(httpd_req_t *req, uint8_t *out)
+{
+    // Each received chunk is decoded into the frame buffer right away, so the
+    // frame is complete as soon as the body ends.
+    size_t input_len = (size_t)req->content_len;
+    upload_decoder_t dec;
+    upload_decoder_init(&dec, out, s_expected_size + EPD_SP6N_HEADER_BYTES, s_expected_size,
+                        input_len, NULL, NULL);
 
-        raw = decoded;
-        raw_len = s_expected_size;
-        ESP_LOGI(TAG, "Image received (rle %u bytes -> raw %u bytes, ratio %.2fx)",
-                 (unsigned)input_len, (unsigned)raw_len,
-                 raw_len ? ((double)input_len / (double)raw_len) : 0.0);
-    } else if (input_len != s_expected_size) {
-        free(input);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
-        notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-        return ESP_FAIL;
-    } else {
+    if (!upload_receive(req, decoder_feed, &dec)) {
+        upload_decoder_release(&dec);
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Receive failed");
+    }
+
+    bool decoded = dec.error == NULL && upload_decoder_finish(&dec);
+    upload_decoder_release(&dec);
+    if (!decoded) {
+        return upload_fail(req, dec.out_of_memory ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST,
+                           dec.error);
+    }
+
+    size_t raw_len = upload_decoded(&dec);
+    if (dec.format == UPLOAD_FORMAT_RAW) {
         ESP_LOGI(TAG, "Image received (raw %u bytes)", (unsigned)raw_len);
+    } else {
+        ESP_LOGI(TAG, "Image received (%s %u bytes -> raw %u bytes, ratio %.2fx)",
+                 upload_format_name(dec.format), (unsigned)input_len, (unsigned)raw_len,
+                 raw_len ? ((double)input_len / (double)raw_len) : 0.0);
     }
 
-    FILE *file = fopen("/spiffs/image.sp6", "wb");
-    if (!file) {
-        free(decoded);
-        free(input);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to open file");
+    const uint8_t *frame = NULL;
+    epd_frame_format_t format = EPD_FRAME_SP6;
+    if (!epd_parse_frame(out, raw_len, &frame, &format)) {
+        return upload_fail(req, HTTPD_400_BAD_REQUEST, "Invalid frame container");
+    }
+
+    return show_received_frame(req, frame, format);
+}
+
+// The upload decodes into a frame pool buffer that is handed to the worker by
+// reference; this handler drops its own reference when it is done.
+static esp_err_t handle_image_post(httpd_req_t *req)
+{
+    notify_status(IMAGE_UPLOAD_STATUS_UPLOADING);
+    if (req->content_len <= 0) {
+        return upload_fail(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+    }
+
+    uint8_t *out = frame_pool_acquire(UPLOAD_BUFFER_TIMEOUT_MS);
+    if (!out) {
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    esp_err_t err = receive_image(req, out);
+    frame_pool_release(out);
+    return err;
+}
+
+typedef struct {
+    uint8_t *frame;
+    epd_frame_format_t base_format;
+    uint32_t base_crc;
+    size_t body_len;
+    uint8_t header[DELTA_HEADER_SIZE];
+    uint8_t record[DELTA_RECORD_SIZE];
+    size_t fill;
+    bool header_done;
+    bool base_mismatch;
+    uint32_t tiles_left;
+    int next_index;
+    const char *error;
+} delta_upload_t;
+
+static bool delta_fail(delta_upload_t *d, const char *error)
+{
+    d->error = error;
+    return false;
+}
+
+static bool delta_check_header(delta_upload_t *d)
+{
+    const uint8_t *h = d->header;
+    if (h[0] != DELTA_MAGIC_0 || h[1] != DELTA_MAGIC_1 || h[2] != DELTA_MAGIC_2 || h[3] != DELTA_MAGIC_3) {
+        return delta_fail(d, "Invalid delta header");
+    }
+    if (h[9] != DELTA_TILE_W_BYTES || h[10] != DELTA_TILE_ROWS) {
+        return delta_fail(d, "Unsupported tile size");
+    }
+    uint32_t count = (uint32_t)h[12] | ((uint32_t)h[13] << 8);
+    if (count > DELTA_TILES_X * DELTA_TILES_Y ||
+        d->body_len != DELTA_HEADER_SIZE + ((size_t)count * DELTA_RECORD_SIZE)) {
+        return delta_fail(d, "Delta length mismatch");
+    }
+    if (read_u32_le(h + 4) != d->base_crc || h[8] != (uint8_t)d->base_format) {
+        d->base_mismatch = true;
+        return delta_fail(d, "Base frame mismatch");
+    }
+    d->tiles_left = count;
+    d->header_done = true;
+    return true;
+}
+
+static bool delta_apply_tile(delta_upload_t *d)
+{
+    int index = (int)((uint32_t)d->record[0] | ((uint32_t)d->record[1] << 8));
+    // Strictly ascending indices keep a tile from being sent twice.
+    if (index >= (int)(DELTA_TILES_X * DELTA_TILES_Y) || index < d->next_index) {
+        return delta_fail(d, "Invalid tile index");
+    }
+    d->next_index = index + 1;
+
+    size_t row = (size_t)(index / (int)DELTA_TILES_X) * DELTA_TILE_ROWS;
+    size_t col = (size_t)(index % (int)DELTA_TILES_X) * DELTA_TILE_W_BYTES;
+    const uint8_t *src = d->record + 2;
+    for (size_t r = 0; r < DELTA_TILE_ROWS; r++) {
+        memcpy(d->frame + ((row + r) * DELTA_ROW_BYTES) + col, src, DELTA_TILE_W_BYTES);
+        src += DELTA_TILE_W_BYTES;
+    }
+    d->tiles_left--;
+    return true;
+}
+
+static bool delta_feed(void *ctx, const uint8_t *data, size_t len)
+{
+    delta_upload_t *d = ctx;
+
+    while (len > 0) {
+        uint8_t *dst = d->header_done ? d->record : d->header;
+        size_t want = (d->header_done ? DELTA_RECORD_SIZE : DELTA_HEADER_SIZE) - d->fill;
+        size_t take = len < want ? len : want;
+        memcpy(dst + d->fill, data, take);
+        d->fill += take;
+        data += take;
+        len -= take;
+        if (d->fill < (d->header_done ? DELTA_RECORD_SIZE : DELTA_HEADER_SIZE)) {
+            break;
+        }
+        d->fill = 0;
+        if (!(d->header_done ? delta_apply_tile(d) : delta_check_header(d))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Applies changed tiles to a copy of the stored frame. A client whose base is
+// not the stored frame gets 409 and falls back to a full upload.
+static esp_err_t handle_image_delta_post(httpd_req_t *req)
+{
+    notify_status(IMAGE_UPLOAD_STATUS_UPLOADING);
+    if (req->content_len < DELTA_HEADER_SIZE) {
+        return upload_fail(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+    }
+
+    uint8_t *out = frame_pool_acquire(UPLOAD_BUFFER_TIMEOUT_MS);
+    if (!out) {
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    delta_upload_t d = {
+        .frame = out,
+        .body_len = (size_t)req->content_len,
+    };
+    if (!frame_store_read_latest(out, &d.base_format, &d.base_crc)) {
+        frame_pool_release(out);
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "No stored base frame");
         notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-        return ESP_FAIL;
+        return ESP_OK;
     }
 
-    if (fwrite(raw, 1, raw_len, file) != raw_len) {
-        fclose(file);
-        free(decoded);
-        free(input);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Write failed");
+    esp_err_t err;
+    if (!upload_receive(req, delta_feed, &d)) {
+        err = upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Receive failed");
+    } else if (d.base_mismatch) {
+        ESP_LOGI(TAG, "Delta base %08x does not match the stored frame %08x",
+                 (unsigned)read_u32_le(d.header + 4), (unsigned)d.base_crc);
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, d.error);
         notify_status(IMAGE_UPLOAD_STATUS_IDLE);
-        return ESP_FAIL;
+        err = ESP_OK;
+    } else if (d.error || !d.header_done || d.tiles_left > 0) {
+        err = upload_fail(req, HTTPD_400_BAD_REQUEST, d.error ? d.error : "Truncated delta");
+    } else {
+        ESP_LOGI(TAG, "Delta received (%u bytes, %d tiles)", (unsigned)req->content_len,
+                 (int)((req->content_len - DELTA_HEADER_SIZE) / DELTA_RECORD_SIZE));
+        err = show_received_frame(req, out, d.base_format);
     }
+    frame_pool_release(out);
+    return err;
+}
 
-    fclose(file);
+typedef struct {
+    uint8_t header[EPD_SP6N_HEADER_BYTES];
+    size_t header_len;
+    bool started;
+    epd_show_result_t begin_result;
+} stream_upload_t;
 
-    if (s_handler) {
-        if (scd30_display_begin(60000)) {
-            s_handler(raw, raw_len);
-            scd30_display_end();
-        } else {
-            ESP_LOGW(TAG, "Power domain busy, skipping display update");
+// Decoder sink for /image/stream: checks the SP6N header, then starts the
+// streamed refresh and pushes plane bytes into its ring.
+static bool stream_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    stream_upload_t *st = ctx;
+
+    while (st->header_len < EPD_SP6N_HEADER_BYTES && len > 0) {
+        st->header[st->header_len++] = *data++;
+        len--;
+    }
+    if (!st->started) {
+        if (st->header_len < EPD_SP6N_HEADER_BYTES) {
+            return true;
+        }
+        if (!epd_native_header_valid(st->header)) {
+            st->begin_result = EPD_SHOW_INVALID;
+            return false;
         }
+        st->begin_result = epd_stream_begin();
+        if (st->begin_result != EPD_SHOW_QUEUED) {
+            return false;
+        }
+        // The panel is about to change, so the stored frame no longer matches
+        // it; a stream that never started leaves both alone.
+        frame_store_invalidate();
+        st->started = true;
+    }
+    return len == 0 || epd_stream_write(data, len);
+}
+
+static esp_err_t handle_image_stream_post(httpd_req_t *req)
+{
+    notify_status(IMAGE_UPLOAD_STATUS_UPLOADING);
+    if (req->content_len <= 0) {
+        return upload_fail(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+    }
+
+    // Only an SP6N frame can be streamed: its planes arrive in transfer order.
+    // Nothing frame-sized is allocated, just the staging window here and the
+    // worker's ring.
+    stream_upload_t st = {
+        .begin_result = EPD_SHOW_QUEUED,
+    };
+    uint8_t staging[UPLOAD_STREAM_STAGING];
+    upload_decoder_t dec;
+    upload_decoder_init(&dec, staging, sizeof(staging), s_expected_size, (size_t)req->content_len,
+                        stream_sink, &st);
+
+    int64_t start_us = esp_timer_get_time();
+    bool received = upload_receive(req, decoder_feed, &dec);
+    bool decoded = received && dec.error == NULL && upload_decoder_finish(&dec);
+    upload_decoder_release(&dec);
+    if (decoded && upload_decoded(&dec) != s_expected_size + EPD_SP6N_HEADER_BYTES) {
+        decoded = false;
+        dec.error = "Stream needs an SP6N frame";
+    }
+    int64_t body_us = esp_timer_get_time() - start_us;
+
+    epd_show_result_t result = st.started ? epd_stream_end(decoded) : st.begin_result;
+    ESP_LOGI(TAG, "Streamed %s upload (%u bytes in %lld ms, refresh result %d)",
+             upload_format_name(dec.format), (unsigned)req->content_len, (long long)(body_us / 1000),
+             (int)result);
+
+    if (!received) {
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Receive failed");
+    }
+    if (!st.started && st.begin_result == EPD_SHOW_INVALID) {
+        return upload_fail(req, HTTPD_400_BAD_REQUEST, "Stream needs an SP6N frame");
+    }
+    if (result == EPD_SHOW_BUSY) {
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Display busy");
+    }
+    if (!decoded) {
+        return upload_fail(req, dec.out_of_memory ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST,
+                           dec.error);
+    }
+    if (result != EPD_SHOW_OK) {
+        return upload_fail(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Display update failed");
     }
 
-    free(decoded);
-    free(input);
     httpd_resp_sendstr(req, "OK");
     notify_status(IMAGE_UPLOAD_STATUS_IDLE);
     return ESP_OK;
@@ -849,6 +1083,22 @@ static httpd_handle_t start_webserver(void)
     };
     httpd_register_uri_handler(server, &image);
 
+    httpd_uri_t image_stream = {
+        .uri = "/image/stream",
+        .method = HTTP_POST,
+        .handler = handle_image_stream_post,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &image_stream);
+
+    httpd_uri_t image_delta = {
+        .uri = "/image/delta",
+        .method = HTTP_POST,
+        .handler = handle_image_delta_post,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &image_delta);
+
     httpd_uri_t scd30 = {
         .uri = "/scd30",
         .method = HTTP_GET,
@@ -881,6 +1131,22 @@ static httpd_handle_t start_webserver(void)
     };
     httpd_register_uri_handler(server, &scd30_auto);
 
+    httpd_uri_t epd_metrics = {
+        .uri = "/epd/metrics",
+        .method = HTTP_GET,
+        .handler = handle_epd_metrics_get,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &epd_metrics);
+
+    httpd_uri_t epd_stats = {
+        .uri = "/epd/stats",
+        .method = HTTP_GET,
+        .handler = handle_epd_stats_get,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &epd_stats);
+
     return server;
 }
 
@@ -4,7 +4,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
-typedef void (*image_upload_handler_t)(const uint8_t *data, size_t length);
+#include "epd_169inch.h"
+
+typedef epd_show_result_t (*image_upload_handler_t)(const uint8_t *data, size_t length,
+                                                    epd_frame_format_t format);
 
 typedef enum {
 	IMAGE_UPLOAD_STATUS_BOOT = 0,
@@ -6,9 +6,9 @@
 #include <math.h>
 
 #include "config.h"
-#include "epd_169inch.h"
+#include "epd_worker.h"
+#include "frame_pool.h"
 #include "esp_log.h"
-#include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -30,6 +30,8 @@
 #define PANEL_HEIGHT 400
 #define PANEL_RADIUS ((PANEL_WIDTH / 2) - 1)
 
+#define SCD30_FRAME_ACQUIRE_MS 5000
+
 #define GRAPH_MIRROR_X 0
 #define GRAPH_MIRROR_Y 0
 
@@ -73,35 +75,15 @@ static uint32_t s_last_render_ms;
 static uint32_t s_nvs_save_counter;
 static bool s_nvs_ready;
 
+// Frame pool buffer being drawn into; only set while a render holds
+// s_render_lock.
 static uint8_t *s_sp6;
 
 static SemaphoreHandle_t s_power_lock;
+static SemaphoreHandle_t s_render_lock;
 static bool s_power_init;
 static bool s_power_enabled;
 
-static bool alloc_buffers(void)
-{
-    if (s_sp6) {
-        return true;
-    }
-
-    size_t sp6_size = (PANEL_WIDTH * PANEL_HEIGHT) / 2U;
-
-    s_sp6 = heap_caps_malloc(sp6_size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-    if (!s_sp6) {
-        s_sp6 = malloc(sp6_size);
-    }
-
-    if (!s_sp6) {
-        free(s_sp6);
-        s_sp6 = NULL;
-        ESP_LOGE(TAG, "Failed to allocate display buffers");
-        return false;
-    }
-
-    return true;
-}
-
 static void power_domain_init(void)
 {
     if (s_power_init) {
@@ -121,6 +103,7 @@ static void power_domain_init(void)
     gpio_set_level(NEOPIXEL_PWR_PIN, s_power_enabled ? 1 : 0);
 
     s_power_lock = xSemaphoreCreateMutex();
+    s_render_lock = xSemaphoreCreateMutex();
     s_power_init = true;
 }
 
@@ -515,9 +498,18 @@ static void set_pixel(int x, int y, uint8_t color) {
     int rx = GRAPH_MIRROR_X ? (PANEL_WIDTH - 1) - x : x;
     int ry = GRAPH_MIRROR_Y ? (PANEL_HEIGHT - 1) - y : y;
     int sp6_size = (PANEL_WIDTH * PANEL_HEIGHT) / 2;
+#if SCD30_RENDER_NATIVE
+    // Odd sp6 pixels belong to the slave plane; within a plane byte the high
+    // nibble is the first of each pixel pair of that plane.
+    int plane = (rx & 1) ? (sp6_size / 2) : 0;
+    int out_index = plane + (ry * (PANEL_WIDTH / 4)) + (rx / 4);
+
+    if ((rx & 2) == 0) {
+#else
     int out_index = (ry * PANEL_WIDTH + rx) / 2;
 
     if ((rx & 1) == 0) {
+#endif
         if (out_index >= 0 && out_index < sp6_size) {
             s_sp6[out_index] = (s_sp6[out_index] & 0x0F) | (uint8_t)(color << 4);
         }
@@ -638,11 +630,11 @@ static void draw_tick(int cx, int cy, int radius, float angle_deg, uint8_t color
     draw_line_thick(x0, y0, x1, y1, color, thickness);
 }
 
-static void render_graph(const scd30_history_point_t *points, size_t count,
+static bool render_graph(const scd30_history_point_t *points, size_t count,
                          const scd30_minmax_t *minmax)
 {
-    if (!alloc_buffers() || !points || count == 0 || !minmax) {
-        return;
+    if (!s_sp6 || !points || count == 0 || !minmax) {
+        return false;
     }
 
     size_t sp6_size = (PANEL_WIDTH * PANEL_HEIGHT) / 2U;
@@ -729,8 +721,7 @@ static void render_graph(const scd30_history_point_t *points, size_t count,
     draw_text(plot_x, plot_y + plot_h + 8, "CO2", COLOR_RED, 1);
     draw_text(plot_x + 60, plot_y + plot_h + 8, "T", COLOR_BLUE, 1);
     draw_text(plot_x + 90, plot_y + plot_h + 8, "RH", COLOR_GREEN, 1);
-
-    epd_show_image(s_sp6, sp6_size);
+    return true;
 }
 
 bool scd30_display_begin(uint32_t timeout_ms)
@@ -902,9 +893,10 @@ void scd30_render_graph_now(void)
     scd30_minmax_t minmax;
     uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000ULL);
     size_t count;
-    
-    if (!scd30_display_begin(60000)) {
-        ESP_LOGW(TAG, "Power domain busy, skipping display render");
+
+    power_domain_init();
+    if (!s_render_lock || xSemaphoreTake(s_render_lock, pdMS_TO_TICKS(60000)) != pdTRUE) {
+        ESP_LOGW(TAG, "Render busy, skipping display render");
         return;
     }
 
@@ -914,15 +906,26 @@ void scd30_render_graph_now(void)
 
     if (count == 0) {
         ESP_LOGW(TAG, "No SCD30 history to render");
-        scd30_display_end();
+        xSemaphoreGive(s_render_lock);
         return;
     }
 
-    render_graph(points, count, &minmax);
+    // The worker retains the pool buffer and takes the power domain itself,
+    // and only when the panel really needs a refresh.
+    s_sp6 = frame_pool_acquire(SCD30_FRAME_ACQUIRE_MS);
+    if (!s_sp6) {
+        ESP_LOGW(TAG, "No free frame buffer, skipping display render");
+    } else if (render_graph(points, count, &minmax)) {
+        epd_submit_frame(s_sp6, (PANEL_WIDTH * PANEL_HEIGHT) / 2U,
+                         SCD30_RENDER_NATIVE ? EPD_FRAME_NATIVE : EPD_FRAME_SP6, NULL, NULL);
+    }
+    frame_pool_release(s_sp6);
+    s_sp6 = NULL;
+
     portENTER_CRITICAL(&s_data_lock);
     s_last_render_ms = now_ms;
     portEXIT_CRITICAL(&s_data_lock);
-    scd30_display_end();
+    xSemaphoreGive(s_render_lock);
 }
 
 void scd30_set_auto_render(bool enabled, uint32_t interval_sec)
@@ -0,0 +1,704 @@
+#include "upload_decoder.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+#include "epd_169inch.h"
+
+#define RLE_MAGIC_0 0x53
+#define RLE_MAGIC_1 0x50
+#define RLE_MAGIC_2 0x36
+#define RLE_MAGIC_3 0x52
+#define RLE_HEADER_SIZE 8
+
+// SP6V: one byte per run, colour in the high nibble and length 1..15 in the
+// low one; length 0 means a LEB128 varint of length - 16 follows.
+#define RLE2_MAGIC_3 0x56
+#define RLE2_EXT_BASE 16U
+#define RLE2_EXT_MAX_SHIFT 21U
+
+#define PACKED_MAGIC_3 0x50
+#define PACKED_HEADER_SIZE 8
+
+// SP6C: "SP6C", u32 decoded size, u16 line stride in pixels, then a binary
+// range code of every 3-bit pixel. Each pixel's bits are coded MSB first
+// down a 7-node tree whose probabilities are picked by its left, upper and
+// upper-left neighbours, so dithering that repeats along and across lines
+// costs well under a bit per pixel.
+#define CTX_MAGIC_3 0x43
+#define CTX_HEADER_SIZE 10
+#define CTX_CONTEXTS 512U
+#define CTX_HISTORY 512U
+#define CTX_PROB_BITS 11U
+#define CTX_MOVE_BITS 4U
+#define CTX_TOP (1UL << 24)
+#define CTX_INIT_BYTES 5U
+// One bit consumes at most one input byte, so a pixel never needs more.
+#define CTX_PIXEL_BYTES 3U
+#define CTX_INPUT_BUFFER 64U
+
+#define HS_MAGIC_0 0x48
+#define HS_MAGIC_1 0x53
+#define HS_MAGIC_2 0x4B
+#define HS_MAGIC_3 0x31
+#define HS_HEADER_SIZE 10
+#define HS_INPUT_BUFFER_SIZE 256
+#define HS_DECODER_BYTES HEATSHRINK_DECODER_SIZE(HS_INPUT_BUFFER_SIZE, UPLOAD_HS_MAX_WINDOW_BITS)
+
+// Heatshrink decoders are reset into these slots per upload rather than
+// allocated, so an HSK1 upload never touches the heap.
+static uint32_t s_hs_storage[UPLOAD_HS_DECODERS][(HS_DECODER_BYTES + 3U) / 4U];
+static bool s_hs_in_use[UPLOAD_HS_DECODERS];
+static portMUX_TYPE s_hs_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Adaptive model and range decoder state for SP6C.
+struct upload_ctx_model {
+    uint16_t probs[CTX_CONTEXTS][7];
+    // The last CTX_HISTORY pixels, for the neighbours above.
+    uint8_t history[CTX_HISTORY];
+    uint8_t in[CTX_INPUT_BUFFER];
+    size_t in_len;
+    size_t in_pos;
+    size_t received;
+    size_t stride;
+    size_t pixel;
+    size_t pixels;
+    uint32_t range;
+    uint32_t code;
+    bool started;
+    bool overrun;
+};
+
+// The one SP6C model, reset at the start of each upload instead of allocated.
+static upload_ctx_model_t s_ctx_model;
+static bool s_ctx_in_use;
+static portMUX_TYPE s_ctx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t read_u32_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+void upload_decoder_init(upload_decoder_t *dec, uint8_t *out, size_t out_cap, size_t frame_size,
+                         size_t body_len, upload_sink_t sink, void *sink_ctx)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->out = out;
+    dec->out_cap = out_cap;
+    dec->frame_size = frame_size;
+    dec->sink = sink;
+    dec->sink_ctx = sink_ctx;
+    dec->body_len = body_len;
+    dec->header_need = 4;
+}
+
+// Codec payloads may hold a bare sp6 frame or an SP6N container.
+static bool valid_payload_size(const upload_decoder_t *dec, size_t size)
+{
+    return size == dec->frame_size || size == dec->frame_size + EPD_SP6N_HEADER_BYTES;
+}
+
+static heatshrink_decoder *hs_decoder_acquire(uint8_t window_bits, uint8_t lookahead_bits)
+{
+    if (window_bits > UPLOAD_HS_MAX_WINDOW_BITS) {
+        return NULL;
+    }
+
+    int slot = -1;
+    portENTER_CRITICAL(&s_hs_lock);
+    for (int i = 0; i < UPLOAD_HS_DECODERS; i++) {
+        if (!s_hs_in_use[i]) {
+            s_hs_in_use[i] = true;
+            slot = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_hs_lock);
+    if (slot < 0) {
+        return NULL;
+    }
+
+    heatshrink_decoder *hsd = heatshrink_decoder_init(s_hs_storage[slot], sizeof(s_hs_storage[slot]),
+                                                      HS_INPUT_BUFFER_SIZE, window_bits, lookahead_bits);
+    if (!hsd) {
+        portENTER_CRITICAL(&s_hs_lock);
+        s_hs_in_use[slot] = false;
+        portEXIT_CRITICAL(&s_hs_lock);
+    }
+    return hsd;
+}
+
+static void hs_decoder_release(heatshrink_decoder *hsd)
+{
+    for (int i = 0; i < UPLOAD_HS_DECODERS; i++) {
+        if ((void *)hsd == (void *)s_hs_storage[i]) {
+            portENTER_CRITICAL(&s_hs_lock);
+            s_hs_in_use[i] = false;
+            portEXIT_CRITICAL(&s_hs_lock);
+        }
+    }
+}
+
+void upload_decoder_release(upload_decoder_t *dec)
+{
+    if (dec->hsd) {
+        hs_decoder_release(dec->hsd);
+        dec->hsd = NULL;
+    }
+    if (dec->ctx) {
+        portENTER_CRITICAL(&s_ctx_lock);
+        s_ctx_in_use = false;
+        portEXIT_CRITICAL(&s_ctx_lock);
+        dec->ctx = NULL;
+    }
+}
+
+static bool upload_decoder_fail(upload_decoder_t *dec, const char *error)
+{
+    dec->error = error;
+    return false;
+}
+
+size_t upload_decoded(const upload_decoder_t *dec)
+{
+    return dec->out_base + dec->out_len;
+}
+
+static bool upload_flush(upload_decoder_t *dec)
+{
+    if (!dec->sink || dec->out_len == 0) {
+        return true;
+    }
+    if (!dec->sink(dec->sink_ctx, dec->out, dec->out_len)) {
+        return upload_decoder_fail(dec, "Display update aborted");
+    }
+    dec->out_base += dec->out_len;
+    dec->out_len = 0;
+    return true;
+}
+
+static bool upload_raw_write(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    if (len > dec->decoded_size - upload_decoded(dec)) {
+        return upload_decoder_fail(dec, "Invalid content length");
+    }
+    while (len > 0) {
+        size_t n = dec->out_cap - dec->out_len;
+        n = n < len ? n : len;
+        memcpy(dec->out + dec->out_len, data, n);
+        dec->out_len += n;
+        data += n;
+        len -= n;
+        if (dec->out_len == dec->out_cap && !upload_flush(dec)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pixel-only codecs leave the SP6N header out; it is written back here.
+static bool upload_restore_sp6n_header(upload_decoder_t *dec)
+{
+    uint8_t sp6n[EPD_SP6N_HEADER_BYTES] = {
+        'S', 'P', '6', 'N',
+        (uint8_t)dec->frame_size, (uint8_t)(dec->frame_size >> 8),
+        (uint8_t)(dec->frame_size >> 16), (uint8_t)(dec->frame_size >> 24),
+    };
+    return upload_raw_write(dec, sp6n, sizeof(sp6n));
+}
+
+static bool upload_ctx_start(upload_decoder_t *dec)
+{
+    size_t stride = (size_t)dec->header[8] | ((size_t)dec->header[9] << 8);
+    if (!valid_payload_size(dec, dec->decoded_size) || stride == 0 || stride >= CTX_HISTORY - 1U) {
+        return upload_decoder_fail(dec, "Invalid SP6C header");
+    }
+
+    portENTER_CRITICAL(&s_ctx_lock);
+    bool busy = s_ctx_in_use;
+    s_ctx_in_use = true;
+    portEXIT_CRITICAL(&s_ctx_lock);
+    if (busy) {
+        dec->out_of_memory = true;
+        return upload_decoder_fail(dec, "SP6C decoder busy");
+    }
+    upload_ctx_model_t *m = &s_ctx_model;
+    memset(m, 0, sizeof(*m));
+    dec->ctx = m;
+    for (size_t c = 0; c < CTX_CONTEXTS; c++) {
+        for (size_t n = 0; n < 7U; n++) {
+            m->probs[c][n] = 1U << (CTX_PROB_BITS - 1U);
+        }
+    }
+    m->stride = stride;
+    m->pixels = dec->frame_size * 2U;
+    m->range = 0xFFFFFFFFU;
+
+    if (dec->decoded_size != dec->frame_size) {
+        if (!upload_restore_sp6n_header(dec)) {
+            return false;
+        }
+        dec->nibble_index = EPD_SP6N_HEADER_BYTES * 2U;
+    }
+    return true;
+}
+
+// Once the magic (and for codecs the size field) is in, picks the format.
+static bool upload_start_format(upload_decoder_t *dec)
+{
+    const uint8_t *h = dec->header;
+
+    if (dec->format == UPLOAD_FORMAT_UNKNOWN) {
+        if (h[0] == HS_MAGIC_0 && h[1] == HS_MAGIC_1 && h[2] == HS_MAGIC_2 && h[3] == HS_MAGIC_3) {
+            dec->format = UPLOAD_FORMAT_HEATSHRINK;
+            dec->header_need = HS_HEADER_SIZE;
+            return true;
+        }
+        if (h[0] == RLE_MAGIC_0 && h[1] == RLE_MAGIC_1 && h[2] == RLE_MAGIC_2 &&
+            h[3] == RLE_MAGIC_3) {
+            dec->format = UPLOAD_FORMAT_RLE;
+            dec->header_need = RLE_HEADER_SIZE;
+            return true;
+        }
+        if (h[0] == RLE_MAGIC_0 && h[1] == RLE_MAGIC_1 && h[2] == RLE_MAGIC_2 &&
+            h[3] == RLE2_MAGIC_3) {
+            dec->format = UPLOAD_FORMAT_RLE2;
+            dec->header_need = RLE_HEADER_SIZE;
+            return true;
+        }
+        if (h[0] == RLE_MAGIC_0 && h[1] == RLE_MAGIC_1 && h[2] == RLE_MAGIC_2 &&
+            h[3] == PACKED_MAGIC_3) {
+            dec->format = UPLOAD_FORMAT_PACKED;
+            dec->header_need = PACKED_HEADER_SIZE;
+            return true;
+        }
+        if (h[0] == RLE_MAGIC_0 && h[1] == RLE_MAGIC_1 && h[2] == RLE_MAGIC_2 &&
+            h[3] == CTX_MAGIC_3) {
+            dec->format = UPLOAD_FORMAT_CONTEXT;
+            dec->header_need = CTX_HEADER_SIZE;
+            return true;
+        }
+
+        // Anything else is a bare frame or SP6N container; the bytes seen so
+        // far are already part of it.
+        dec->format = UPLOAD_FORMAT_RAW;
+        dec->header_need = 0;
+        if (!valid_payload_size(dec, dec->body_len)) {
+            return upload_decoder_fail(dec, "Invalid content length");
+        }
+        dec->decoded_size = dec->body_len;
+        return upload_raw_write(dec, h, dec->header_len);
+    }
+
+    dec->decoded_size = read_u32_le(&h[4]);
+    dec->header_need = 0;
+    if (dec->format == UPLOAD_FORMAT_RLE || dec->format == UPLOAD_FORMAT_RLE2) {
+        if (!valid_payload_size(dec, dec->decoded_size)) {
+            return upload_decoder_fail(dec, "Invalid RLE size");
+        }
+        return true;
+    }
+    if (dec->format == UPLOAD_FORMAT_CONTEXT) {
+        return upload_ctx_start(dec);
+    }
+    if (dec->format == UPLOAD_FORMAT_PACKED) {
+        if (!valid_payload_size(dec, dec->decoded_size)) {
+            return upload_decoder_fail(dec, "Invalid packed size");
+        }
+        // Only pixels are packed; an SP6N container gets its header back here.
+        if (dec->decoded_size != dec->frame_size) {
+            return upload_restore_sp6n_header(dec);
+        }
+        return true;
+    }
+
+    if (!valid_payload_size(dec, dec->decoded_size)) {
+        return upload_decoder_fail(dec, "Invalid heatshrink size");
+    }
+    if (h[8] > UPLOAD_HS_MAX_WINDOW_BITS || h[9] < HEATSHRINK_MIN_LOOKAHEAD_BITS || h[9] >= h[8]) {
+        return upload_decoder_fail(dec, "Unsupported heatshrink parameters");
+    }
+    dec->hsd = hs_decoder_acquire(h[8], h[9]);
+    if (!dec->hsd) {
+        dec->out_of_memory = true;
+        return upload_decoder_fail(dec, "Heatshrink decoder busy");
+    }
+    return true;
+}
+
+// Writes a run of one 4-bit value at the current nibble position: an odd
+// leading nibble completes its byte, whole bytes are memset, and an odd
+// trailing nibble starts the next byte.
+static bool upload_fill_nibbles(upload_decoder_t *dec, uint8_t value, size_t count)
+{
+    if (count > (dec->decoded_size * 2U) - dec->nibble_index) {
+        return upload_decoder_fail(dec, "RLE decode failed");
+    }
+    dec->nibble_index += count;
+
+    if ((dec->nibble_index - count) & 1U) {
+        dec->out[dec->out_len++] |= value;
+        count--;
+        if (dec->out_len == dec->out_cap && !upload_flush(dec)) {
+            return false;
+        }
+    }
+    size_t bytes = count / 2U;
+    while (bytes > 0) {
+        size_t n = dec->out_cap - dec->out_len;
+        n = n < bytes ? n : bytes;
+        memset(dec->out + dec->out_len, value * 0x11U, n);
+        dec->out_len += n;
+        bytes -= n;
+        if (dec->out_len == dec->out_cap && !upload_flush(dec)) {
+            return false;
+        }
+    }
+    if (count & 1U) {
+        dec->out[dec->out_len] = (uint8_t)(value << 4);
+    }
+    return true;
+}
+
+static bool upload_rle_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    size_t nibble_total = dec->decoded_size * 2U;
+
+    for (size_t i = 0; i < len && dec->nibble_index < nibble_total; i++) {
+        if (!dec->rle_have_run) {
+            if (data[i] == 0) {
+                return upload_decoder_fail(dec, "RLE decode failed");
+            }
+            dec->rle_run = data[i];
+            dec->rle_have_run = true;
+            continue;
+        }
+
+        dec->rle_have_run = false;
+        if (!upload_fill_nibbles(dec, data[i] & 0x0F, dec->rle_run)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool upload_rle2_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = data[i];
+        if (!dec->rle_in_ext) {
+            if ((b & 0x0FU) != 0) {
+                if (!upload_fill_nibbles(dec, b >> 4, b & 0x0FU)) {
+                    return false;
+                }
+                continue;
+            }
+            dec->rle_value = b >> 4;
+            dec->rle_ext = 0;
+            dec->rle_ext_shift = 0;
+            dec->rle_in_ext = true;
+            continue;
+        }
+
+        // Three varint bytes cover any run in a frame.
+        if (dec->rle_ext_shift >= RLE2_EXT_MAX_SHIFT) {
+            return upload_decoder_fail(dec, "RLE decode failed");
+        }
+        dec->rle_ext |= (uint32_t)(b & 0x7FU) << dec->rle_ext_shift;
+        dec->rle_ext_shift += 7U;
+        if (b & 0x80U) {
+            continue;
+        }
+        dec->rle_in_ext = false;
+        if (!upload_fill_nibbles(dec, dec->rle_value, RLE2_EXT_BASE + dec->rle_ext)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// SP6P: every colour code fits in 3 bits, so 8 pixels travel in 3 bytes
+// (MSB first) and unpack to 4 sp6 bytes. Each 6-bit pair maps to one byte.
+#define SP6P_PAIR(v) (uint8_t)((((v) >> 3) << 4) | ((v) & 7))
+#define SP6P_PAIRS8(v)                                                                  \
+    SP6P_PAIR(v), SP6P_PAIR(v + 1), SP6P_PAIR(v + 2), SP6P_PAIR(v + 3), SP6P_PAIR(v + 4), \
+        SP6P_PAIR(v + 5), SP6P_PAIR(v + 6), SP6P_PAIR(v + 7)
+
+static const uint8_t s_sp6p_pairs[64] = {
+    SP6P_PAIRS8(0),  SP6P_PAIRS8(8),  SP6P_PAIRS8(16), SP6P_PAIRS8(24),
+    SP6P_PAIRS8(32), SP6P_PAIRS8(40), SP6P_PAIRS8(48), SP6P_PAIRS8(56),
+};
+
+static bool upload_packed_group(upload_decoder_t *dec, const uint8_t *g)
+{
+    uint32_t w = ((uint32_t)g[0] << 16) | ((uint32_t)g[1] << 8) | g[2];
+    uint8_t *o = dec->out + dec->out_len;
+
+    // Output windows and the optional SP6N header are multiples of 4 bytes,
+    // so a group never straddles a flush.
+    o[0] = s_sp6p_pairs[w >> 18];
+    o[1] = s_sp6p_pairs[(w >> 12) & 0x3FU];
+    o[2] = s_sp6p_pairs[(w >> 6) & 0x3FU];
+    o[3] = s_sp6p_pairs[w & 0x3FU];
+    dec->out_len += 4U;
+    return dec->out_len < dec->out_cap || upload_flush(dec);
+}
+
+static bool upload_packed_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    while (len > 0 && upload_decoded(dec) < dec->decoded_size) {
+        if (dec->packed_carry_len > 0 || len < 3U) {
+            dec->packed_carry[dec->packed_carry_len++] = *data++;
+            len--;
+            if (dec->packed_carry_len == 3U) {
+                dec->packed_carry_len = 0;
+                if (!upload_packed_group(dec, dec->packed_carry)) {
+                    return false;
+                }
+            }
+            continue;
+        }
+        if (!upload_packed_group(dec, data)) {
+            return false;
+        }
+        data += 3;
+        len -= 3U;
+    }
+    return true;
+}
+
+static uint8_t upload_ctx_byte(upload_ctx_model_t *m)
+{
+    // A complete body always holds every byte the coder reads.
+    if (m->in_pos == m->in_len) {
+        m->overrun = true;
+        return 0;
+    }
+    return m->in[m->in_pos++];
+}
+
+static unsigned upload_ctx_bit(upload_ctx_model_t *m, uint16_t *prob)
+{
+    uint32_t bound = (m->range >> CTX_PROB_BITS) * *prob;
+    unsigned bit;
+    if (m->code < bound) {
+        m->range = bound;
+        *prob += ((1U << CTX_PROB_BITS) - *prob) >> CTX_MOVE_BITS;
+        bit = 0;
+    } else {
+        m->code -= bound;
+        m->range -= bound;
+        *prob -= *prob >> CTX_MOVE_BITS;
+        bit = 1;
+    }
+    if (m->range < CTX_TOP) {
+        m->range <<= 8;
+        m->code = (m->code << 8) | upload_ctx_byte(m);
+    }
+    return bit;
+}
+
+static uint8_t upload_ctx_neighbour(const upload_ctx_model_t *m, size_t back)
+{
+    return m->pixel >= back ? m->history[(m->pixel - back) & (CTX_HISTORY - 1U)] : 0;
+}
+
+static bool upload_ctx_pixel(upload_decoder_t *dec, upload_ctx_model_t *m)
+{
+    size_t c = ((size_t)upload_ctx_neighbour(m, 1) << 6) |
+               ((size_t)upload_ctx_neighbour(m, m->stride) << 3) |
+               upload_ctx_neighbour(m, m->stride + 1U);
+    unsigned node = 1;
+    while (node < 8U) {
+        node = (node << 1) | upload_ctx_bit(m, &m->probs[c][node - 1U]);
+    }
+    uint8_t value = (uint8_t)(node - 8U);
+    m->history[m->pixel & (CTX_HISTORY - 1U)] = value;
+    m->pixel++;
+
+    if (dec->nibble_index++ & 1U) {
+        dec->out[dec->out_len++] |= value;
+        return dec->out_len < dec->out_cap || upload_flush(dec);
+    }
+    dec->out[dec->out_len] = (uint8_t)(value << 4);
+    return true;
+}
+
+// Input is staged in m->in so that a pixel is only decoded once every byte it
+// could need has arrived (or the body has ended).
+static bool upload_ctx_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    upload_ctx_model_t *m = dec->ctx;
+
+    while (len > 0 && m->pixel < m->pixels) {
+        size_t n = CTX_INPUT_BUFFER - m->in_len;
+        n = n < len ? n : len;
+        memcpy(m->in + m->in_len, data, n);
+        m->in_len += n;
+        m->received += n;
+        data += n;
+        len -= n;
+        bool last = dec->header_len + m->received >= dec->body_len;
+
+        if (!m->started) {
+            if (m->in_len < CTX_INIT_BYTES && !last) {
+                continue;
+            }
+            for (size_t i = 0; i < CTX_INIT_BYTES; i++) {
+                m->code = (m->code << 8) | upload_ctx_byte(m);
+            }
+            m->started = true;
+        }
+        while (m->pixel < m->pixels && (last || m->in_len - m->in_pos >= CTX_PIXEL_BYTES)) {
+            if (!upload_ctx_pixel(dec, m)) {
+                return false;
+            }
+        }
+        if (m->overrun) {
+            return upload_decoder_fail(dec, "SP6C decode failed");
+        }
+        memmove(m->in, m->in + m->in_pos, m->in_len - m->in_pos);
+        m->in_len -= m->in_pos;
+        m->in_pos = 0;
+    }
+    return true;
+}
+
+static bool upload_hs_poll(upload_decoder_t *dec)
+{
+    for (;;) {
+        size_t polled = 0;
+        size_t left = dec->decoded_size - upload_decoded(dec);
+        if (left == 0) {
+            // Output is full: anything still pending means the size was wrong.
+            uint8_t spare;
+            HSD_poll_res res = heatshrink_decoder_poll(dec->hsd, &spare, 1, &polled);
+            if (polled > 0 || res < 0) {
+                return upload_decoder_fail(dec, "Heatshrink decode failed");
+            }
+            return true;
+        }
+        size_t room = dec->out_cap - dec->out_len;
+        HSD_poll_res res = heatshrink_decoder_poll(dec->hsd, dec->out + dec->out_len,
+                                                   room < left ? room : left, &polled);
+        dec->out_len += polled;
+        if (dec->out_len == dec->out_cap && !upload_flush(dec)) {
+            return false;
+        }
+        if (res == HSDR_POLL_EMPTY) {
+            return true;
+        }
+        if (res < 0) {
+            return upload_decoder_fail(dec, "Heatshrink decode failed");
+        }
+    }
+}
+
+static bool upload_hs_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t sunk = 0;
+        if (heatshrink_decoder_sink(dec->hsd, (uint8_t *)data, len, &sunk) < 0) {
+            return upload_decoder_fail(dec, "Heatshrink decode failed");
+        }
+        data += sunk;
+        len -= sunk;
+        if (!upload_hs_poll(dec)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool upload_decoder_feed(upload_decoder_t *dec, const uint8_t *data, size_t len)
+{
+    while (dec->header_need > 0 && len > 0) {
+        dec->header[dec->header_len++] = *data++;
+        len--;
+        if (dec->header_len == dec->header_need && !upload_start_format(dec)) {
+            return false;
+        }
+    }
+    if (len == 0) {
+        return true;
+    }
+
+    switch (dec->format) {
+        case UPLOAD_FORMAT_RAW:
+            return upload_raw_write(dec, data, len);
+        case UPLOAD_FORMAT_RLE:
+            return upload_rle_feed(dec, data, len);
+        case UPLOAD_FORMAT_RLE2:
+            return upload_rle2_feed(dec, data, len);
+        case UPLOAD_FORMAT_CONTEXT:
+            return upload_ctx_feed(dec, data, len);
+        case UPLOAD_FORMAT_HEATSHRINK:
+            return upload_hs_feed(dec, data, len);
+        case UPLOAD_FORMAT_PACKED:
+            return upload_packed_feed(dec, data, len);
+        default:
+            return upload_decoder_fail(dec, "Invalid content length");
+    }
+}
+
+bool upload_decoder_finish(upload_decoder_t *dec)
+{
+    if (dec->header_need > 0) {
+        return upload_decoder_fail(dec, "Invalid content length");
+    }
+
+    if (dec->format == UPLOAD_FORMAT_HEATSHRINK) {
+        for (;;) {
+            HSD_finish_res res = heatshrink_decoder_finish(dec->hsd);
+            if (res == HSDR_FINISH_DONE) {
+                break;
+            }
+            if (res < 0) {
+                return upload_decoder_fail(dec, "Heatshrink decode failed");
+            }
+            if (!upload_hs_poll(dec)) {
+                return false;
+            }
+            if (upload_decoded(dec) >= dec->decoded_size) {
+                break;
+            }
+        }
+    }
+
+    if (upload_decoded(dec) != dec->decoded_size) {
+        switch (dec->format) {
+            case UPLOAD_FORMAT_RLE:
+            case UPLOAD_FORMAT_RLE2:
+                return upload_decoder_fail(dec, "RLE decode failed");
+            case UPLOAD_FORMAT_HEATSHRINK:
+                return upload_decoder_fail(dec, "Heatshrink decode failed");
+            case UPLOAD_FORMAT_PACKED:
+                return upload_decoder_fail(dec, "Packed decode failed");
+            case UPLOAD_FORMAT_CONTEXT:
+                return upload_decoder_fail(dec, "SP6C decode failed");
+            default:
+                return upload_decoder_fail(dec, "Invalid content length");
+        }
+    }
+    return upload_flush(dec);
+}
+
+const char *upload_format_name(upload_format_t format)
+{
+    switch (format) {
+        case UPLOAD_FORMAT_RLE:
+            return "rle";
+        case UPLOAD_FORMAT_RLE2:
+            return "rle2";
+        case UPLOAD_FORMAT_HEATSHRINK:
+            return "heatshrink";
+        case UPLOAD_FORMAT_PACKED:
+            return "packed";
+        case UPLOAD_FORMAT_CONTEXT:
+            return "sp6c";
+        default:
+            return "raw";
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef UPLOAD_DECODER_H
+#define UPLOAD_DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heatshrink_decoder.h"
+
+// Longest codec header (HSK1 and SP6C), magic included.
+#define UPLOAD_DECODER_HEADER_MAX 10
+
+typedef enum {
+    UPLOAD_FORMAT_UNKNOWN = 0,
+    UPLOAD_FORMAT_RAW,
+    UPLOAD_FORMAT_RLE,
+    UPLOAD_FORMAT_HEATSHRINK,
+    UPLOAD_FORMAT_PACKED,
+    UPLOAD_FORMAT_RLE2,
+    UPLOAD_FORMAT_CONTEXT,
+} upload_format_t;
+
+typedef struct upload_ctx_model upload_ctx_model_t;
+
+// Incremental upload decoder: bytes are fed as they arrive from the socket
+// and decoded straight into the frame buffer, so no copy of the body is kept.
+// Receives decoded bytes in order when the decoder runs without a frame buffer.
+typedef bool (*upload_sink_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    upload_format_t format;
+    uint8_t header[UPLOAD_DECODER_HEADER_MAX];
+    size_t header_len;
+    size_t header_need;
+    size_t frame_size;
+    size_t body_len;
+    uint8_t *out;
+    size_t out_cap;
+    size_t out_len;
+    // Bytes already handed to the sink; out then holds only the tail.
+    size_t out_base;
+    upload_sink_t sink;
+    void *sink_ctx;
+    size_t decoded_size;
+    size_t nibble_index;
+    uint8_t rle_run;
+    bool rle_have_run;
+    uint8_t rle_value;
+    uint32_t rle_ext;
+    uint8_t rle_ext_shift;
+    bool rle_in_ext;
+    uint8_t packed_carry[3];
+    size_t packed_carry_len;
+    heatshrink_decoder *hsd;
+    upload_ctx_model_t *ctx;
+    bool out_of_memory;
+    const char *error;
+} upload_decoder_t;
+
+// frame_size is the bare sp6 frame size; an SP6N container adds its header.
+// With a sink, out is only a staging window that is flushed whenever it fills.
+void upload_decoder_init(upload_decoder_t *dec, uint8_t *out, size_t out_cap, size_t frame_size,
+                         size_t body_len, upload_sink_t sink, void *sink_ctx);
+// Returns false and sets dec->error once the body is rejected.
+bool upload_decoder_feed(upload_decoder_t *dec, const uint8_t *data, size_t len);
+// Flushes the codec and checks that exactly one frame came out.
+bool upload_decoder_finish(upload_decoder_t *dec);
+void upload_decoder_release(upload_decoder_t *dec);
+size_t upload_decoded(const upload_decoder_t *dec);
+const char *upload_format_name(upload_format_t format);
+
+#endif
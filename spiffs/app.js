@@ -33,7 +33,22 @@ const PALETTE = [
 
 const PANEL_ROTATION_DEG = 180;
 const RLE_MAGIC = [0x53, 0x50, 0x36, 0x52];
+const RLE2_MAGIC = [0x53, 0x50, 0x36, 0x56];
+const PACKED_MAGIC = [0x53, 0x50, 0x36, 0x50];
+const CONTEXT_MAGIC = [0x53, 0x50, 0x36, 0x43];
+// SP6C models a pixel from its left and upper neighbours, so it is coded from
+// the sp6 layout, where those are the true neighbours.
+const CONTEXT_STRIDE = 400;
+const SP6N_MAGIC = [0x53, 0x50, 0x36, 0x4e];
+// Send controller-native planes so the device skips the transpose.
+const UPLOAD_NATIVE_PLANES = true;
 const HS_MAGIC = [0x48, 0x53, 0x4b, 0x31];
+const DELTA_MAGIC = [0x53, 0x50, 0x36, 0x44];
+// SP6D tiles cut the frame as a byte grid of 200-byte rows (16x16 sp6 pixels).
+const DELTA_ROW_BYTES = 200;
+const DELTA_TILE_W = 8;
+const DELTA_TILE_ROWS = 16;
+// Used when the WASM module predates the auto search (no hs_last_params).
 const HS_WINDOW_BITS = 10;
 const HS_LOOKAHEAD_BITS = 4;
 
@@ -44,8 +59,15 @@ let isDragging = false;
 let dragStart = { x: 0, y: 0 };
 let pendingRender = false;
 let lastRawBytes = null;
+let lastSp6Bytes = null;
 let lastRleBytes = null;
+let lastRle2Bytes = null;
 let lastHeatshrinkBytes = null;
+let lastPackedBytes = null;
+let lastContextBytes = null;
+// Frame the device stored on the last successful upload: the delta base.
+let lastUploadedRaw = null;
+let crcTable = null;
 let userRotationDeg = 0;
 let greenBoost = Number(greenBoostInput?.value || 1.2);
 
@@ -272,14 +294,24 @@ async function encodeHeatshrink(rawBytes) {
 
   refreshHeatshrinkHeap();
   heatshrinkHeap.set(rawBytes, inPtr);
+  // Window bits 0 asks the module for the smallest of every setting the
+  // device decodes.
+  const auto = typeof heatshrinkExports.hs_last_params === "function";
+  let windowBits = auto ? 0 : HS_WINDOW_BITS;
+  let lookaheadBits = auto ? 0 : HS_LOOKAHEAD_BITS;
   const outSize = heatshrinkExports.hs_encode(
     inPtr,
     rawBytes.length,
     outPtr,
     outCap,
-    HS_WINDOW_BITS,
-    HS_LOOKAHEAD_BITS
+    windowBits,
+    lookaheadBits
   );
+  if (auto && outSize > 0) {
+    const params = heatshrinkExports.hs_last_params() >>> 0;
+    windowBits = (params >> 8) & 0xff;
+    lookaheadBits = params & 0xff;
+  }
 
   let encoded = null;
   if (outSize > 0) {
@@ -291,8 +323,8 @@ async function encodeHeatshrink(rawBytes) {
     header[5] = (size >> 8) & 0xff;
     header[6] = (size >> 16) & 0xff;
     header[7] = (size >> 24) & 0xff;
-    header[8] = HS_WINDOW_BITS & 0xff;
-    header[9] = HS_LOOKAHEAD_BITS & 0xff;
+    header[8] = windowBits;
+    header[9] = lookaheadBits;
 
     const payload = heatshrinkHeap.slice(outPtr, outPtr + outSize);
     encoded = new Uint8Array(header.length + payload.length);
@@ -421,7 +453,7 @@ function distributeError(buffer, width, height, x, y, errR, errG, errB, factor)
   buffer[idx + 2] += errB * factor;
 }
 
-function packSp6() {
+function packSp6(native = false) {
   const ctx = previewCanvas.getContext("2d");
   const imageData = ctx.getImageData(0, 0, previewCanvas.width, previewCanvas.height);
   const data = imageData.data;
@@ -450,6 +482,25 @@ function packSp6() {
     }
   }
 
+  return native ? sp6ToNative(out) : out;
+}
+
+// SP6N container: master plane (high nibbles) then slave plane (low nibbles),
+// each byte merging two neighbouring sp6 bytes the way the controllers expect.
+function sp6ToNative(sp6) {
+  const planeLen = sp6.length / 2;
+  const out = new Uint8Array(8 + sp6.length);
+  out.set(SP6N_MAGIC, 0);
+  out[4] = sp6.length & 0xff;
+  out[5] = (sp6.length >> 8) & 0xff;
+  out[6] = (sp6.length >> 16) & 0xff;
+  out[7] = (sp6.length >> 24) & 0xff;
+  for (let j = 0; j < planeLen; j++) {
+    const a = sp6[j * 2];
+    const b = sp6[j * 2 + 1];
+    out[8 + j] = (a & 0xf0) | (b >> 4);
+    out[8 + planeLen + j] = ((a & 0x0f) << 4) | (b & 0x0f);
+  }
   return out;
 }
 
@@ -490,6 +541,275 @@ function encodeRleSp6Nibbles(rawBytes) {
   return new Uint8Array(out);
 }
 
+// SP6V: one byte per run (value in the high nibble, length 1..15 in the low
+// one); length 0 is followed by a LEB128 varint of length - 16.
+function encodeRle2Sp6Nibbles(rawBytes) {
+  const out = [];
+  out.push(...RLE2_MAGIC);
+  const rawSize = rawBytes.length;
+  out.push(rawSize & 0xff, (rawSize >> 8) & 0xff, (rawSize >> 16) & 0xff, (rawSize >> 24) & 0xff);
+
+  const emit = (value, length) => {
+    if (length < 16) {
+      out.push((value << 4) | length);
+      return;
+    }
+    out.push(value << 4);
+    let rest = length - 16;
+    while (rest >= 0x80) {
+      out.push((rest & 0x7f) | 0x80);
+      rest >>>= 7;
+    }
+    out.push(rest);
+  };
+
+  let runValue = rawBytes.length ? rawBytes[0] >> 4 : 0;
+  let runLength = 0;
+  for (let i = 0; i < rawBytes.length; i++) {
+    const byte = rawBytes[i];
+    for (const nibble of [byte >> 4, byte & 0x0f]) {
+      if (nibble === runValue) {
+        runLength++;
+      } else {
+        emit(runValue, runLength);
+        runValue = nibble;
+        runLength = 1;
+      }
+    }
+  }
+  if (runLength) emit(runValue, runLength);
+
+  return new Uint8Array(out);
+}
+
+// SP6P: six colour codes fit in 3 bits, so 8 pixels go in 3 bytes (MSB
+// first). An SP6N header stays out of the packed bits; the size field tells the
+// device to restore it.
+function packSp6p(rawBytes) {
+  const hasHeader = rawBytes.length >= 4 && SP6N_MAGIC.every((b, i) => rawBytes[i] === b);
+  const start = hasHeader ? 8 : 0;
+  const pixelBytes = rawBytes.length - start;
+  const out = new Uint8Array(8 + (pixelBytes / 4) * 3);
+  out.set(PACKED_MAGIC, 0);
+  const rawSize = rawBytes.length;
+  out.set([rawSize & 0xff, (rawSize >> 8) & 0xff, (rawSize >> 16) & 0xff, (rawSize >> 24) & 0xff], 4);
+
+  let o = 8;
+  for (let i = start; i < rawBytes.length; i += 4) {
+    let word = 0;
+    for (let k = 0; k < 4; k++) {
+      const byte = rawBytes[i + k];
+      word = (word << 6) | (((byte >> 4) & 0x07) << 3) | (byte & 0x07);
+    }
+    out[o++] = (word >> 16) & 0xff;
+    out[o++] = (word >> 8) & 0xff;
+    out[o++] = word & 0xff;
+  }
+  return out;
+}
+
+function crc32(bytes) {
+  if (!crcTable) {
+    crcTable = new Uint32Array(256);
+    for (let i = 0; i < 256; i++) {
+      let c = i;
+      for (let k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+      }
+      crcTable[i] = c >>> 0;
+    }
+  }
+  let crc = 0xffffffff;
+  for (let i = 0; i < bytes.length; i++) {
+    crc = crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xffffffff) >>> 0;
+}
+
+// Frame bytes as the device stores them: without the SP6N header.
+function frameBytes(rawBytes) {
+  const native = rawBytes.length >= 4 && SP6N_MAGIC.every((b, i) => rawBytes[i] === b);
+  return { format: native ? 1 : 0, frame: native ? rawBytes.subarray(8) : rawBytes };
+}
+
+// SP6D: the tiles that differ from the base, each as a u16 index and its rows.
+function encodeDelta(baseRaw, rawBytes) {
+  const base = frameBytes(baseRaw);
+  const next = frameBytes(rawBytes);
+  if (base.format !== next.format || base.frame.length !== next.frame.length) {
+    return null;
+  }
+
+  const tilesX = DELTA_ROW_BYTES / DELTA_TILE_W;
+  const tilesY = next.frame.length / DELTA_ROW_BYTES / DELTA_TILE_ROWS;
+  const tileBytes = DELTA_TILE_W * DELTA_TILE_ROWS;
+  const records = [];
+  for (let index = 0; index < tilesX * tilesY; index++) {
+    const row = Math.floor(index / tilesX) * DELTA_TILE_ROWS;
+    const col = (index % tilesX) * DELTA_TILE_W;
+    let changed = false;
+    for (let r = 0; r < DELTA_TILE_ROWS && !changed; r++) {
+      const at = (row + r) * DELTA_ROW_BYTES + col;
+      for (let c = 0; c < DELTA_TILE_W; c++) {
+        if (base.frame[at + c] !== next.frame[at + c]) {
+          changed = true;
+          break;
+        }
+      }
+    }
+    if (changed) {
+      records.push({ index, row, col });
+    }
+  }
+
+  const out = new Uint8Array(14 + records.length * (2 + tileBytes));
+  out.set(DELTA_MAGIC, 0);
+  const crc = crc32(base.frame);
+  out.set([crc & 0xff, (crc >>> 8) & 0xff, (crc >>> 16) & 0xff, (crc >>> 24) & 0xff], 4);
+  out.set([next.format, DELTA_TILE_W, DELTA_TILE_ROWS, 0], 8);
+  out.set([records.length & 0xff, (records.length >> 8) & 0xff], 12);
+  let o = 14;
+  for (const { index, row, col } of records) {
+    out[o++] = index & 0xff;
+    out[o++] = (index >> 8) & 0xff;
+    for (let r = 0; r < DELTA_TILE_ROWS; r++) {
+      const at = (row + r) * DELTA_ROW_BYTES + col;
+      out.set(next.frame.subarray(at, at + DELTA_TILE_W), o);
+      o += DELTA_TILE_W;
+    }
+  }
+  return out;
+}
+
+async function postBytes(url, body) {
+  return fetch(url, {
+    method: "POST",
+    headers: { "Content-Type": "application/octet-stream" },
+    body,
+  });
+}
+
+// Binary range coder (LZMA style, 11-bit probabilities) behind SP6C. low can
+// exceed 32 bits, so it is kept as a plain number rather than bit-twiddled.
+function encodeSp6cJs(frame, stride) {
+  const probs = new Uint16Array(512 * 7).fill(1024);
+  const out = [];
+  let low = 0;
+  let range = 0xffffffff;
+  let cache = 0;
+  let cacheSize = 1;
+
+  const shiftLow = () => {
+    if (low < 0xff000000 || low >= 0x100000000) {
+      const carry = low >= 0x100000000 ? 1 : 0;
+      let temp = cache;
+      do {
+        out.push((temp + carry) & 0xff);
+        temp = 0xff;
+      } while (--cacheSize !== 0);
+      cache = Math.floor(low / 0x1000000) & 0xff;
+    }
+    cacheSize++;
+    low = (low % 0x1000000) * 256;
+  };
+
+  const pixel = (i) => (i & 1 ? frame[i >> 1] & 0x0f : frame[i >> 1] >> 4);
+  const pixels = frame.length * 2;
+  for (let i = 0; i < pixels; i++) {
+    const value = pixel(i);
+    if (value > 7) return null;
+    const left = i >= 1 ? pixel(i - 1) : 0;
+    const up = i >= stride ? pixel(i - stride) : 0;
+    const upLeft = i >= stride + 1 ? pixel(i - stride - 1) : 0;
+    const base = ((left << 6) | (up << 3) | upLeft) * 7;
+    let node = 1;
+    for (let shift = 2; shift >= 0; shift--) {
+      const bit = (value >> shift) & 1;
+      const index = base + node - 1;
+      const prob = probs[index];
+      const bound = Math.floor(range / 2048) * prob;
+      if (bit === 0) {
+        range = bound;
+        probs[index] = prob + ((2048 - prob) >> 4);
+      } else {
+        low += bound;
+        range -= bound;
+        probs[index] = prob - (prob >> 4);
+      }
+      while (range < 0x1000000) {
+        range *= 256;
+        shiftLow();
+      }
+      node = (node << 1) | bit;
+    }
+  }
+  for (let i = 0; i < 5; i++) shiftLow();
+  return new Uint8Array(out);
+}
+
+// Uses the WASM encoder when the module was built with it.
+async function encodeSp6c(sp6) {
+  let payload = null;
+  const ok = await loadHeatshrinkWasm();
+  if (ok && heatshrinkExports.sp6c_encode) {
+    const outCap = sp6.length + 64;
+    const inPtr = heatshrinkExports.hs_alloc(sp6.length);
+    const outPtr = heatshrinkExports.hs_alloc(outCap);
+    if (inPtr && outPtr) {
+      refreshHeatshrinkHeap();
+      heatshrinkHeap.set(sp6, inPtr);
+      const outSize = heatshrinkExports.sp6c_encode(inPtr, sp6.length, CONTEXT_STRIDE, outPtr, outCap);
+      refreshHeatshrinkHeap();
+      payload = outSize > 0 ? heatshrinkHeap.slice(outPtr, outPtr + outSize) : null;
+    }
+    if (inPtr) heatshrinkExports.hs_free(inPtr);
+    if (outPtr) heatshrinkExports.hs_free(outPtr);
+  }
+  if (!payload) {
+    payload = encodeSp6cJs(sp6, CONTEXT_STRIDE);
+    if (!payload) return null;
+  }
+
+  const out = new Uint8Array(10 + payload.length);
+  out.set(CONTEXT_MAGIC, 0);
+  const size = sp6.length;
+  out.set([size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff, (size >> 24) & 0xff], 4);
+  out.set([CONTEXT_STRIDE & 0xff, CONTEXT_STRIDE >> 8], 8);
+  out.set(payload, 10);
+  return out;
+}
+
+async function encodeUploads() {
+  lastRawBytes = packSp6(UPLOAD_NATIVE_PLANES);
+  lastHeatshrinkBytes = await encodeHeatshrink(lastRawBytes);
+  const candidateRle = encodeRleSp6Nibbles(lastRawBytes);
+  lastRleBytes = candidateRle.length < lastRawBytes.length ? candidateRle : null;
+  lastRle2Bytes = encodeRle2Sp6Nibbles(lastRawBytes);
+  lastPackedBytes = packSp6p(lastRawBytes);
+  lastSp6Bytes = UPLOAD_NATIVE_PLANES ? packSp6(false) : lastRawBytes;
+  lastContextBytes = await encodeSp6c(lastSp6Bytes);
+}
+
+// Smallest of the encodings; dithered photos usually end up as SP6C, flat
+// graphs and dashboards as SP6V.
+// Each candidate also names the frame it decodes to, the next delta base.
+function pickPayload() {
+  let best = { name: "raw", bytes: lastRawBytes, raw: lastRawBytes };
+  const candidates = [
+    { name: "heatshrink", bytes: lastHeatshrinkBytes, raw: lastRawBytes },
+    { name: "rle", bytes: lastRleBytes, raw: lastRawBytes },
+    { name: "rle2", bytes: lastRle2Bytes, raw: lastRawBytes },
+    { name: "packed", bytes: lastPackedBytes, raw: lastRawBytes },
+    { name: "sp6c", bytes: lastContextBytes, raw: lastSp6Bytes },
+  ];
+  for (const candidate of candidates) {
+    if (candidate.bytes && candidate.bytes.length < best.bytes.length) {
+      best = candidate;
+    }
+  }
+  return best;
+}
+
 fileInput.addEventListener("change", (event) => {
   const file = event.target.files[0];
   if (!file) return;
@@ -553,16 +873,11 @@ convertBtn.addEventListener("click", async () => {
     return;
   }
   renderPreview();
-  lastRawBytes = packSp6();
-  lastHeatshrinkBytes = await encodeHeatshrink(lastRawBytes);
-
-  const candidateRle = encodeRleSp6Nibbles(lastRawBytes);
-  lastRleBytes = candidateRle.length < lastRawBytes.length ? candidateRle : null;
+  await encodeUploads();
 
-  if (lastHeatshrinkBytes && lastHeatshrinkBytes.length < lastRawBytes.length) {
-    setStatus(`Converted: raw ${lastRawBytes.length}B, heatshrink ${lastHeatshrinkBytes.length}B (${formatRatio(lastHeatshrinkBytes.length, lastRawBytes.length)})`);
-  } else if (lastRleBytes) {
-    setStatus(`Converted: raw ${lastRawBytes.length}B, rle ${lastRleBytes.length}B (${formatRatio(lastRleBytes.length, lastRawBytes.length)})`);
+  const best = pickPayload();
+  if (best.name !== "raw") {
+    setStatus(`Converted: raw ${lastRawBytes.length}B, ${best.name} ${best.bytes.length}B (${formatRatio(best.bytes.length, lastRawBytes.length)})`);
   } else {
     setStatus(`Converted: raw ${lastRawBytes.length}B, no compression`);
   }
@@ -571,29 +886,39 @@ convertBtn.addEventListener("click", async () => {
 uploadBtn.addEventListener("click", async () => {
   if (!lastRawBytes) {
     renderPreview();
-    lastRawBytes = packSp6();
-    lastHeatshrinkBytes = await encodeHeatshrink(lastRawBytes);
-    const candidateRle = encodeRleSp6Nibbles(lastRawBytes);
-    lastRleBytes = candidateRle.length < lastRawBytes.length ? candidateRle : null;
+    await encodeUploads();
   }
   const url = deviceUrlInput.value || "/image";
   setStatus("Uploading...");
   try {
-    const payload =
-      (lastHeatshrinkBytes && lastHeatshrinkBytes.length < lastRawBytes.length)
-        ? lastHeatshrinkBytes
-        : (lastRleBytes || lastRawBytes);
+    const best = pickPayload();
+    let payload = best.bytes;
+    let uploadedRaw = best.raw;
+    // Diff in the layout of the stored frame so that the formats match.
+    const baseIsSp6 = lastUploadedRaw && frameBytes(lastUploadedRaw).format === 0;
+    const deltaRaw = baseIsSp6 ? lastSp6Bytes : lastRawBytes;
+    const delta = lastUploadedRaw ? encodeDelta(lastUploadedRaw, deltaRaw) : null;
+    let response = null;
+    if (delta && delta.length < payload.length) {
+      response = await postBytes(`${url.replace(/\/$/, "")}/delta`, delta);
+      if (response.status === 409) {
+        // The device holds a different base (rebooted, streamed, another client).
+        response = null;
+      } else {
+        payload = delta;
+        uploadedRaw = deltaRaw;
+      }
+    }
     const ratio = formatRatio(payload.length, lastRawBytes.length);
-    console.log("upload", { raw: lastRawBytes.length, payload: payload.length, ratio });
-    const response = await fetch(url, {
-      method: "POST",
-      headers: { "Content-Type": "application/octet-stream" },
-      body: payload,
-    });
+    console.log("upload", { raw: lastRawBytes.length, payload: payload.length, ratio, delta: payload === delta });
+    if (!response) {
+      response = await postBytes(url, payload);
+    }
     if (!response.ok) {
       throw new Error(`Upload failed: ${response.status}`);
     }
-    setStatus(`Upload complete: ${payload.length}B (${ratio})`);
+    lastUploadedRaw = uploadedRaw;
+    setStatus(`Upload complete: ${payload.length}B (${ratio})${payload === delta ? ", changed tiles only" : ""}`);
   } catch (err) {
     setStatus(`Upload failed: ${err.message}`);
   }
@@ -608,7 +933,7 @@ downloadBtn.addEventListener("click", () => {
   const url = URL.createObjectURL(blob);
   const link = document.createElement("a");
   link.href = url;
-  link.download = "image.sp6";
+  link.download = UPLOAD_NATIVE_PLANES ? "image.sp6n" : "image.sp6";
   document.body.appendChild(link);
   link.click();
   document.body.removeChild(link);
@@ -6,7 +6,9 @@
 #endif
 
 #define HEATSHRINK_DEBUGGING_LOGS 0
+#ifndef HEATSHRINK_USE_INDEX
 #define HEATSHRINK_USE_INDEX 0
+#endif
 
 #if HEATSHRINK_DYNAMIC_ALLOC
 #ifndef HEATSHRINK_MALLOC
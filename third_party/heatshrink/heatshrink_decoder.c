@@ -42,27 +42,50 @@ typedef struct {
 
 static uint16_t get_bits(heatshrink_decoder *hsd, uint8_t count);
 static void push_byte(heatshrink_decoder *hsd, output_info *oi, uint8_t byte);
+static void refill_bits(heatshrink_decoder *hsd);
+static void yield_literals(heatshrink_decoder *hsd, output_info *oi);
 
 #if HEATSHRINK_DYNAMIC_ALLOC
+static int decoder_params_valid(uint16_t input_buffer_size,
+                                uint8_t window_sz2,
+                                uint8_t lookahead_sz2)
+{
+    return (window_sz2 >= HEATSHRINK_MIN_WINDOW_BITS) &&
+        (window_sz2 <= HEATSHRINK_MAX_WINDOW_BITS) &&
+        (input_buffer_size != 0) &&
+        (lookahead_sz2 >= HEATSHRINK_MIN_LOOKAHEAD_BITS) &&
+        (lookahead_sz2 < window_sz2);
+}
+
+heatshrink_decoder *heatshrink_decoder_init(void *storage, size_t storage_size,
+                                            uint16_t input_buffer_size,
+                                            uint8_t window_sz2,
+                                            uint8_t lookahead_sz2)
+{
+    if ((storage == NULL) ||
+        !decoder_params_valid(input_buffer_size, window_sz2, lookahead_sz2) ||
+        (storage_size < HEATSHRINK_DECODER_SIZE(input_buffer_size, window_sz2))) {
+        return NULL;
+    }
+    heatshrink_decoder *hsd = storage;
+    hsd->input_buffer_size = input_buffer_size;
+    hsd->window_sz2 = window_sz2;
+    hsd->lookahead_sz2 = lookahead_sz2;
+    heatshrink_decoder_reset(hsd);
+    return hsd;
+}
+
 heatshrink_decoder *heatshrink_decoder_alloc(uint16_t input_buffer_size,
                                              uint8_t window_sz2,
                                              uint8_t lookahead_sz2)
 {
-    if ((window_sz2 < HEATSHRINK_MIN_WINDOW_BITS) ||
-        (window_sz2 > HEATSHRINK_MAX_WINDOW_BITS) ||
-        (input_buffer_size == 0) ||
-        (lookahead_sz2 < HEATSHRINK_MIN_LOOKAHEAD_BITS) ||
-        (lookahead_sz2 >= window_sz2)) {
+    if (!decoder_params_valid(input_buffer_size, window_sz2, lookahead_sz2)) {
         return NULL;
     }
-    size_t buffers_sz = (1 << window_sz2) + input_buffer_size;
-    size_t sz = sizeof(heatshrink_decoder) + buffers_sz;
+    size_t sz = HEATSHRINK_DECODER_SIZE(input_buffer_size, window_sz2);
     heatshrink_decoder *hsd = HEATSHRINK_MALLOC(sz);
     if (hsd == NULL) { return NULL; }
-    hsd->input_buffer_size = input_buffer_size;
-    hsd->window_sz2 = window_sz2;
-    hsd->lookahead_sz2 = lookahead_sz2;
-    heatshrink_decoder_reset(hsd);
+    heatshrink_decoder_init(hsd, sz, input_buffer_size, window_sz2, lookahead_sz2);
     LOG("-- allocated decoder with buffer size of %zu (%zu + %u + %u)\n",
         sz, sizeof(heatshrink_decoder), (1 << window_sz2), input_buffer_size);
     return hsd;
@@ -83,8 +106,8 @@ void heatshrink_decoder_reset(heatshrink_decoder *hsd) {
     hsd->state = HSDS_TAG_BIT;
     hsd->input_size = 0;
     hsd->input_index = 0;
-    hsd->bit_index = 0x00;
-    hsd->current_byte = 0x00;
+    hsd->bit_count = 0;
+    hsd->bit_buffer = 0;
     hsd->output_count = 0;
     hsd->output_index = 0;
     hsd->head_index = 0;
@@ -139,6 +162,7 @@ HSD_poll_res heatshrink_decoder_poll(heatshrink_decoder *hsd,
         uint8_t in_state = hsd->state;
         switch (in_state) {
         case HSDS_TAG_BIT:
+            yield_literals(hsd, &oi);
             hsd->state = st_tag_bit(hsd);
             break;
         case HSDS_YIELD_LITERAL:
@@ -240,72 +264,109 @@ static HSD_state st_backref_count_lsb(heatshrink_decoder *hsd) {
 static HSD_state st_yield_backref(heatshrink_decoder *hsd, output_info *oi) {
     size_t count = oi->buf_size - *oi->output_size;
     if (count > 0) {
-        size_t i = 0;
         if (hsd->output_count < count) count = hsd->output_count;
         uint8_t *buf = &hsd->buffers[HEATSHRINK_DECODER_INPUT_BUFFER_SIZE(hsd)];
-        uint16_t mask = (1 << HEATSHRINK_DECODER_WINDOW_BITS(hsd)) - 1;
+        size_t window_sz = (size_t)1 << HEATSHRINK_DECODER_WINDOW_BITS(hsd);
+        uint16_t mask = (uint16_t)(window_sz - 1);
         uint16_t neg_offset = hsd->output_index;
         ASSERT(neg_offset <= mask + 1);
         ASSERT(count <= (size_t)(1 << BACKREF_COUNT_BITS(hsd)));
 
-        for (i = 0; i < count; i++) {
-            uint8_t c = buf[(hsd->head_index - neg_offset) & mask];
-            push_byte(hsd, oi, c);
-            buf[hsd->head_index & mask] = c;
-            hsd->head_index++;
+        size_t src = (uint16_t)(hsd->head_index - neg_offset) & mask;
+        size_t dst = hsd->head_index & mask;
+        uint8_t *out = &oi->buf[*oi->output_size];
+        if (count <= neg_offset && src + count <= window_sz && dst + count <= window_sz) {
+            /* The source lies wholly behind the copy and neither side wraps,
+             * so whole blocks move at once (src == dst for a full-window
+             * offset, hence memmove). */
+            memcpy(out, &buf[src], count);
+            memmove(&buf[dst], &buf[src], count);
+        } else {
+            /* Overlapping runs repeat bytes written by this very copy. */
+            size_t i;
+            for (i = 0; i < count; i++) {
+                uint8_t c = buf[(src + i) & mask];
+                out[i] = c;
+                buf[(dst + i) & mask] = c;
+            }
         }
+        *oi->output_size += count;
+        hsd->head_index += (uint16_t)count;
         hsd->output_count -= count;
         if (hsd->output_count == 0) { return HSDS_TAG_BIT; }
     }
     return HSDS_YIELD_BACKREF;
 }
 
+/* Tops the bit buffer up with whole input bytes while they fit. */
+static void refill_bits(heatshrink_decoder *hsd) {
+    while ((hsd->bit_count <= 24) && (hsd->input_size != 0)) {
+        hsd->bit_buffer |= (uint32_t)hsd->buffers[hsd->input_index++] << (24 - hsd->bit_count);
+        hsd->bit_count += 8;
+        if (hsd->input_index == hsd->input_size) {
+            hsd->input_index = 0;
+            hsd->input_size = 0;
+        }
+    }
+}
+
+/* Bits are only consumed once all of them are available, so a field split
+ * across sink calls just waits for the next one. */
 static uint16_t get_bits(heatshrink_decoder *hsd, uint8_t count) {
-    uint16_t accumulator = 0;
-    int i = 0;
     if (count > 15) { return NO_BITS; }
-
-    if (hsd->input_size == 0) {
-        if (hsd->bit_index < (1 << (count - 1))) { return NO_BITS; }
+    if (hsd->bit_count < count) {
+        refill_bits(hsd);
+        if (hsd->bit_count < count) { return NO_BITS; }
     }
+    uint16_t bits = (uint16_t)(hsd->bit_buffer >> (32 - count));
+    hsd->bit_buffer <<= count;
+    hsd->bit_count -= count;
+    return bits;
+}
 
-    for (i = 0; i < count; i++) {
-        if (hsd->bit_index == 0x00) {
-            if (hsd->input_size == 0) {
-                return NO_BITS;
-            }
-            hsd->current_byte = hsd->buffers[hsd->input_index++];
-            if (hsd->input_index == hsd->input_size) {
-                hsd->input_index = 0;
-                hsd->input_size = 0;
-            }
-            hsd->bit_index = 0x80;
+/* Fast path for literal runs: a set tag bit and its 8 data bits come
+ * straight off the bit buffer without a trip through the state machine. */
+static void yield_literals(heatshrink_decoder *hsd, output_info *oi) {
+    uint8_t *buf = &hsd->buffers[HEATSHRINK_DECODER_INPUT_BUFFER_SIZE(hsd)];
+    uint16_t mask = (1 << HEATSHRINK_DECODER_WINDOW_BITS(hsd)) - 1;
+    while (*oi->output_size < oi->buf_size) {
+        if (hsd->bit_count < 9) {
+            refill_bits(hsd);
+            if (hsd->bit_count < 9) { return; }
         }
-        accumulator <<= 1;
-        if (hsd->current_byte & hsd->bit_index) {
-            accumulator |= 0x01;
-        }
-        hsd->bit_index >>= 1;
+        if ((hsd->bit_buffer & 0x80000000u) == 0) { return; }
+        uint8_t c = (uint8_t)(hsd->bit_buffer >> 23);
+        hsd->bit_buffer <<= 9;
+        hsd->bit_count -= 9;
+        buf[hsd->head_index++ & mask] = c;
+        oi->buf[(*oi->output_size)++] = c;
     }
+}
 
-    return accumulator;
+/* Bits the current state needs before it can move on. */
+static uint8_t bits_needed(const heatshrink_decoder *hsd) {
+    uint8_t index_bits = BACKREF_INDEX_BITS(hsd);
+    uint8_t count_bits = BACKREF_COUNT_BITS(hsd);
+    switch (hsd->state) {
+    case HSDS_TAG_BIT: return 1;
+    case HSDS_YIELD_LITERAL: return 8;
+    case HSDS_BACKREF_INDEX_MSB: return index_bits - 8;
+    case HSDS_BACKREF_INDEX_LSB: return index_bits < 8 ? index_bits : 8;
+    case HSDS_BACKREF_COUNT_MSB: return count_bits - 8;
+    case HSDS_BACKREF_COUNT_LSB: return count_bits < 8 ? count_bits : 8;
+    default: return 0;
+    }
 }
 
 HSD_finish_res heatshrink_decoder_finish(heatshrink_decoder *hsd) {
     if (hsd == NULL) { return HSDR_FINISH_ERROR_NULL; }
-    switch (hsd->state) {
-    case HSDS_TAG_BIT:
-        return hsd->input_size == 0 ? HSDR_FINISH_DONE : HSDR_FINISH_MORE;
-    case HSDS_BACKREF_INDEX_LSB:
-    case HSDS_BACKREF_INDEX_MSB:
-    case HSDS_BACKREF_COUNT_LSB:
-    case HSDS_BACKREF_COUNT_MSB:
-        return hsd->input_size == 0 ? HSDR_FINISH_DONE : HSDR_FINISH_MORE;
-    case HSDS_YIELD_LITERAL:
-        return hsd->input_size == 0 ? HSDR_FINISH_DONE : HSDR_FINISH_MORE;
-    default:
-        return HSDR_FINISH_MORE;
+    if (hsd->state == HSDS_YIELD_BACKREF) { return HSDR_FINISH_MORE; }
+    /* Done once the input is used up and the buffered bits cannot complete
+     * the next field: what is left is the last byte's padding. */
+    if ((hsd->input_size == 0) && (hsd->bit_count < bits_needed(hsd))) {
+        return HSDR_FINISH_DONE;
     }
+    return HSDR_FINISH_MORE;
 }
 
 static void push_byte(heatshrink_decoder *hsd, output_info *oi, uint8_t byte) {
@@ -32,8 +32,8 @@ typedef struct {
     uint16_t output_index;
     uint16_t head_index;
     uint8_t state;
-    uint8_t current_byte;
-    uint8_t bit_index;
+    uint8_t bit_count;      /* valid bits in bit_buffer, MSB aligned */
+    uint32_t bit_buffer;
 
 #if HEATSHRINK_DYNAMIC_ALLOC
     uint8_t window_sz2;
@@ -60,6 +60,16 @@ typedef struct {
 heatshrink_decoder *heatshrink_decoder_alloc(uint16_t input_buffer_size,
     uint8_t expansion_buffer_sz2, uint8_t lookahead_sz2);
 void heatshrink_decoder_free(heatshrink_decoder *hsd);
+
+/* Bytes a decoder with these parameters needs, for caller-owned storage. */
+#define HEATSHRINK_DECODER_SIZE(INPUT_BUFFER_SIZE, WINDOW_SZ2) \
+    (sizeof(heatshrink_decoder) + (1U << (WINDOW_SZ2)) + (INPUT_BUFFER_SIZE))
+
+/* Sets up a decoder in storage of storage_size bytes (suitably aligned)
+ * instead of allocating it. Returns NULL if the parameters are invalid or
+ * do not fit. Nothing needs to be freed. */
+heatshrink_decoder *heatshrink_decoder_init(void *storage, size_t storage_size,
+    uint16_t input_buffer_size, uint8_t expansion_buffer_sz2, uint8_t lookahead_sz2);
 #endif
 
 void heatshrink_decoder_reset(heatshrink_decoder *hsd);
@@ -381,6 +381,26 @@ static uint16_t find_longest_match(heatshrink_encoder *hse, uint16_t start,
     uint16_t len = 0;
     uint8_t * const needlepoint = &buf[end];
 
+#if HEATSHRINK_USE_INDEX
+    /* Walk only the earlier positions holding the same first byte. */
+    struct hs_index *hsi = HEATSHRINK_ENCODER_INDEX(hse);
+    int16_t pos = hsi->index[end];
+
+    while (pos - (int16_t)start >= 0) {
+        uint8_t * const pospoint = &buf[pos];
+        if (pospoint[match_maxlen] == needlepoint[match_maxlen]) {
+            for (len = 1; len < maxlen; len++) {
+                if (pospoint[len] != needlepoint[len]) { break; }
+            }
+            if (len > match_maxlen) {
+                match_maxlen = len;
+                match_index = pos;
+                if (len == maxlen) { break; }
+            }
+        }
+        pos = hsi->index[pos];
+    }
+#else
     for (int16_t pos = end - 1; pos - (int16_t)start >= 0; pos--) {
         uint8_t * const pospoint = &buf[pos];
         if ((pospoint[match_maxlen] == needlepoint[match_maxlen])
@@ -395,6 +415,7 @@ static uint16_t find_longest_match(heatshrink_encoder *hse, uint16_t start,
             }
         }
     }
+#endif
 
     const size_t break_even_point =
       (1 + HEATSHRINK_ENCODER_WINDOW_BITS(hse) +
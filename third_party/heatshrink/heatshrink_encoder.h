@@ -28,7 +28,7 @@ typedef enum {
 #if HEATSHRINK_DYNAMIC_ALLOC
 #define HEATSHRINK_ENCODER_WINDOW_BITS(HSE) ((HSE)->window_sz2)
 #define HEATSHRINK_ENCODER_LOOKAHEAD_BITS(HSE) ((HSE)->lookahead_sz2)
-#define HEATSHRINK_ENCODER_INDEX(HSE) (&(HSE)->search_index)
+#define HEATSHRINK_ENCODER_INDEX(HSE) ((HSE)->search_index)
 struct hs_index {
     uint16_t size;
     int16_t index[];
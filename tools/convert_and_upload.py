@@ -53,19 +53,26 @@ def main() -> int:
     )
     parser.add_argument(
         "--packing",
-        choices=["sp6", "nibble", "byte"],
+        choices=["sp6", "sp6n", "nibble", "byte"],
         default="sp6",
-        help="Output packing: sp6 (default), nibble, or byte",
+        help="Output packing: sp6 (default), sp6n (controller planes), nibble, or byte",
     )
     parser.add_argument("--rle", action="store_true", help="Upload with nibble RLE")
+    parser.add_argument("--rle2", action="store_true", help="Upload with SP6V nibble RLE")
+    parser.add_argument("--pack3", action="store_true",
+                        help="Upload as SP6P, 3 bits per pixel")
+    parser.add_argument("--sp6c", action="store_true",
+                        help="Upload as SP6C (context-modelled, best for dithered photos)")
     parser.add_argument("--heatshrink-wasm", action="store_true",
                         help="Upload with heatshrink (WASM encoder)")
     parser.add_argument("--wasm", default="",
                         help="Path to heatshrink.wasm for encoding")
-    parser.add_argument("--window-bits", type=int, default=10,
-                        help="Heatshrink window bits")
+    parser.add_argument("--window-bits", default="10",
+                        help="Heatshrink window bits, or 'auto'")
     parser.add_argument("--lookahead-bits", type=int, default=4,
                         help="Heatshrink lookahead bits")
+    parser.add_argument("--delta-cache", default="",
+                        help="Last uploaded frame; only changed tiles are sent (see upload_image.py)")
     parser.add_argument("--keep-raw", action="store_true", help="Keep the temporary raw file")
     args = parser.parse_args()
 
@@ -117,8 +124,16 @@ def main() -> int:
             upload_cmd.extend(["--wasm", args.wasm])
         upload_cmd.extend(["--window-bits", str(args.window_bits)])
         upload_cmd.extend(["--lookahead-bits", str(args.lookahead_bits)])
+    elif args.sp6c:
+        upload_cmd.append("--sp6c")
+    elif args.rle2:
+        upload_cmd.append("--rle2")
     elif args.rle:
         upload_cmd.append("--rle")
+    elif args.pack3:
+        upload_cmd.append("--pack3")
+    if args.delta_cache:
+        upload_cmd.extend(["--delta-cache", args.delta_cache])
 
     run(upload_cmd)
 
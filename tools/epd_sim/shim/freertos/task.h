@@ -0,0 +1,11 @@
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+// Advances the simulated clock instead of sleeping.
+void vTaskDelay(TickType_t ticks);
+
+#endif
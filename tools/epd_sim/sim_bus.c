@@ -0,0 +1,686 @@
+// Simulated epd_169inch_bus backend: two UC8179-style controllers sharing
+// SCL/SDA/DC/BUSY with separate chip selects, driven on a virtual clock.
+
+#include "epd_169inch_bus.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sim_panel.h"
+
+#define SIM_DEFAULT_CLOCK_HZ 250000U
+#define SIM_CHUNK_SIZE 4000U
+#define SIM_FILL_SIZE 1000U
+#define SIM_OTP_BYTES 256U
+
+// Host-side costs of the ESP32-S3 driver around each SPI transaction.
+#define SIM_POLL_OVERHEAD_NS 9000U
+#define SIM_QUEUE_OVERHEAD_NS 14000U
+
+#define SIM_BUSY_TIMEOUT_DEFAULT_MS 10000U
+#define SIM_BUSY_TIMEOUT_POWER_ON_MS 3000U
+#define SIM_BUSY_TIMEOUT_REFRESH_MS 45000U
+#define SIM_BUSY_TIMEOUT_POWER_OFF_MS 3000U
+#define SIM_BUSY_TIMEOUT_TEMPTR_MS 1000U
+
+#define SIM_BUSY_LOG_SAMPLES 256U
+
+typedef struct {
+    const char *name;
+    uint8_t cmd;
+    uint32_t arg_index;
+    uint32_t read_index;
+    uint8_t psr[2];
+    uint8_t ram[SIM_PLANE_BYTES];
+    uint32_t ram_written;
+    bool ram_valid;
+    bool powered;
+    bool otp_unlocked;
+    bool asleep;
+} sim_ctrl_t;
+
+static const char *TAG = "epd_sim";
+
+static sim_panel_config_t s_cfg;
+static bool s_cfg_set;
+static sim_ctrl_t s_ctrl[2] = {
+    {.name = "master", .cmd = 0xFF},
+    {.name = "slave", .cmd = 0xFF},
+};
+static uint8_t s_otp[SIM_OTP_BYTES];
+static uint8_t s_displayed[SIM_FRAME_BYTES];
+static uint32_t s_refresh_count;
+static uint32_t s_errors;
+
+static uint64_t s_now_ns;
+static uint64_t s_busy_until_ns;
+static uint32_t s_clock_hz = SIM_DEFAULT_CLOCK_HZ;
+
+static sim_phase_t s_phase = SIM_PHASE_SETUP;
+static sim_phase_stats_t s_stats[SIM_PHASE_COUNT];
+
+static epd_ms_target_t s_stream_target;
+static bool s_stream_open;
+
+static const char *const s_phase_names[SIM_PHASE_COUNT] = {
+    "setup/otp", "xfer master", "xfer slave", "xfer both", "power on", "refresh", "power off",
+};
+
+void sim_panel_default_config(sim_panel_config_t *cfg)
+{
+    // Placeholder BUSY times; replace them with a capture from the unit under
+    // test via sim_panel_load_busy_log().
+    *cfg = (sim_panel_config_t){
+        .busy_reset_ms = 2,
+        .busy_power_on_ms = 110,
+        .busy_refresh_ms = 16500,
+        .busy_power_off_ms = 40,
+        .busy_temptr_ms = 5,
+        .max_read_hz = 12000000,
+        .reset_clears_ram = false,
+        .temperature = 23,
+        .vcom = 0x1E,
+        .pwr = {0x2B, 0x2B, 0x27, 0x17, 0x2C},
+    };
+}
+
+void sim_panel_configure(const sim_panel_config_t *cfg)
+{
+    s_cfg = *cfg;
+    s_cfg_set = true;
+    for (uint32_t i = 0; i < SIM_OTP_BYTES; i++) {
+        s_otp[i] = (uint8_t)((i * 37U) + 11U);
+    }
+    s_otp[207] = s_cfg.vcom;
+}
+
+static void ensure_configured(void)
+{
+    if (!s_cfg_set) {
+        sim_panel_config_t cfg;
+        sim_panel_default_config(&cfg);
+        sim_panel_configure(&cfg);
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t median_u32(uint32_t *v, size_t n)
+{
+    qsort(v, n, sizeof(v[0]), cmp_u32);
+    return v[n / 2];
+}
+
+int sim_panel_load_busy_log(sim_panel_config_t *cfg, const char *path)
+{
+    static const uint8_t cmds[] = {
+        EPD_CMD_NONE, EPD_CMD_POWER_ON, EPD_CMD_REFRESH, EPD_CMD_POWER_OFF, EPD_CMD_TEMPTR,
+    };
+    uint32_t *fields[] = {
+        &cfg->busy_reset_ms, &cfg->busy_power_on_ms, &cfg->busy_refresh_ms,
+        &cfg->busy_power_off_ms, &cfg->busy_temptr_ms,
+    };
+    enum { N = sizeof(cmds) / sizeof(cmds[0]) };
+    static uint32_t samples[N][SIM_BUSY_LOG_SAMPLES];
+    size_t counts[N] = {0};
+    char line[512];
+    int used = 0;
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "Busy signal cleared after ");
+        unsigned ms;
+        unsigned cmd;
+        if (!p || sscanf(p, "Busy signal cleared after %u ms (cmd 0x%x)", &ms, &cmd) != 2) {
+            continue;
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (cmds[i] == cmd && counts[i] < SIM_BUSY_LOG_SAMPLES) {
+                samples[i][counts[i]++] = ms;
+            }
+        }
+    }
+    fclose(f);
+
+    for (size_t i = 0; i < N; i++) {
+        if (counts[i] > 0) {
+            *fields[i] = median_u32(samples[i], counts[i]);
+            used++;
+        }
+    }
+    return used;
+}
+
+uint64_t sim_now_ns(void)
+{
+    return s_now_ns;
+}
+
+void sim_advance_ns(uint64_t ns)
+{
+    s_now_ns += ns;
+    s_stats[s_phase].total_ns += ns;
+}
+
+static void charge_wire(uint64_t ns)
+{
+    s_stats[s_phase].wire_ns += ns;
+    sim_advance_ns(ns);
+}
+
+static uint64_t wire_ns(size_t bytes)
+{
+    return ((uint64_t)bytes * 8U * 1000000000ULL) / s_clock_hz;
+}
+
+const uint8_t *sim_panel_displayed(void)
+{
+    return s_displayed;
+}
+
+uint32_t sim_panel_refresh_count(void)
+{
+    return s_refresh_count;
+}
+
+uint32_t sim_panel_error_count(void)
+{
+    return s_errors;
+}
+
+void sim_stats_reset(void)
+{
+    memset(s_stats, 0, sizeof(s_stats));
+}
+
+const sim_phase_stats_t *sim_stats_phase(sim_phase_t phase)
+{
+    return &s_stats[phase];
+}
+
+void sim_stats_print(FILE *out)
+{
+    uint64_t total = 0;
+
+    fprintf(out, "%-12s %10s %10s %10s %9s %6s %6s\n",
+            "phase", "total ms", "wire ms", "busy ms", "bytes", "cmds", "reads");
+    for (int i = 0; i < SIM_PHASE_COUNT; i++) {
+        const sim_phase_stats_t *s = &s_stats[i];
+        if (s->total_ns == 0 && s->commands == 0) {
+            continue;
+        }
+        fprintf(out, "%-12s %10.1f %10.1f %10.1f %9llu %6u %6u\n", s_phase_names[i],
+                s->total_ns / 1e6, s->wire_ns / 1e6, s->busy_ns / 1e6,
+                (unsigned long long)s->data_bytes, (unsigned)s->commands, (unsigned)s->reads);
+        total += s->total_ns;
+    }
+    fprintf(out, "%-12s %10.1f\n", "total", total / 1e6);
+}
+
+static void sim_error(const char *fmt, const char *what)
+{
+    s_errors++;
+    ESP_LOGE(TAG, fmt, what);
+}
+
+static bool targets(epd_ms_target_t target, int index)
+{
+    return target == EPD_MASTER_SLAVE || (int)target == index;
+}
+
+static void rebuild_displayed(void)
+{
+    const uint8_t *m = s_ctrl[0].ram;
+    const uint8_t *s = s_ctrl[1].ram;
+
+    // Inverse of send_image_plane(): each plane byte carries one nibble of
+    // two neighbouring sp6 bytes, master the high nibbles and slave the low.
+    for (uint32_t col = 0; col < 400; col++) {
+        for (uint32_t row = 0; row < 100; row++) {
+            uint32_t j = (col * 100U) + row;
+            uint8_t *dst = &s_displayed[(col * 200U) + (row * 2U)];
+            dst[0] = (uint8_t)((m[j] & 0xF0) | (s[j] >> 4));
+            dst[1] = (uint8_t)(((m[j] & 0x0F) << 4) | (s[j] & 0x0F));
+        }
+    }
+}
+
+static void start_refresh(void)
+{
+    for (int i = 0; i < 2; i++) {
+        if (!s_ctrl[i].powered) {
+            sim_error("Refresh while %s is powered off", s_ctrl[i].name);
+        }
+        if (!s_ctrl[i].ram_valid) {
+            sim_error("Refresh with incomplete %s data RAM", s_ctrl[i].name);
+        }
+    }
+    if (s_ctrl[0].psr[0] != 0x13) {
+        sim_error("Refresh with %s PSR not set to 0x13", s_ctrl[0].name);
+    }
+    if (s_ctrl[1].psr[0] != 0x17) {
+        sim_error("Refresh with %s PSR not set to 0x17", s_ctrl[1].name);
+    }
+
+    rebuild_displayed();
+    s_refresh_count++;
+}
+
+static void set_busy(uint32_t ms)
+{
+    uint64_t until = s_now_ns + ((uint64_t)ms * 1000000ULL);
+    if (until > s_busy_until_ns) {
+        s_busy_until_ns = until;
+    }
+}
+
+static void update_phase(epd_ms_target_t target, uint8_t cmd)
+{
+    switch (cmd) {
+        case 0x10:
+            s_phase = target == EPD_MASTER_ONLY  ? SIM_PHASE_XFER_MASTER
+                      : target == EPD_SLAVE_ONLY ? SIM_PHASE_XFER_SLAVE
+                                                 : SIM_PHASE_XFER_BOTH;
+            break;
+        case EPD_CMD_POWER_ON:
+            if (s_phase >= SIM_PHASE_XFER_MASTER && s_phase <= SIM_PHASE_XFER_BOTH) {
+                s_phase = SIM_PHASE_POWER_ON;
+            }
+            break;
+        case EPD_CMD_REFRESH:
+            s_phase = SIM_PHASE_REFRESH;
+            break;
+        case EPD_CMD_POWER_OFF:
+            if (s_phase == SIM_PHASE_REFRESH) {
+                s_phase = SIM_PHASE_POWER_OFF;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void ctrl_command(sim_ctrl_t *c, uint8_t cmd)
+{
+    if (c->asleep) {
+        sim_error("Command to %s while in deep sleep", c->name);
+        return;
+    }
+
+    c->cmd = cmd;
+    c->arg_index = 0;
+    c->read_index = 0;
+    switch (cmd) {
+        case 0x10:
+            c->ram_written = 0;
+            break;
+        case EPD_CMD_POWER_ON:
+            c->powered = true;
+            break;
+        case EPD_CMD_POWER_OFF:
+            c->powered = false;
+            break;
+        default:
+            break;
+    }
+}
+
+static void ctrl_data(sim_ctrl_t *c, uint8_t value)
+{
+    if (c->asleep) {
+        return;
+    }
+
+    switch (c->cmd) {
+        case 0x00:
+            if (c->arg_index < 2) {
+                c->psr[c->arg_index] = value;
+            }
+            break;
+        case 0x07:
+            if (value == 0xA5) {
+                c->asleep = true;
+                c->powered = false;
+                c->ram_valid = false;
+            }
+            break;
+        case 0x10:
+            if (c->ram_written >= SIM_PLANE_BYTES) {
+                if (c->ram_written == SIM_PLANE_BYTES) {
+                    sim_error("Data RAM overflow on %s", c->name);
+                }
+                c->ram_written++;
+                break;
+            }
+            c->ram[c->ram_written++] = value;
+            if (c->ram_written == SIM_PLANE_BYTES) {
+                c->ram_valid = true;
+            }
+            break;
+        case 0xF5:
+            c->otp_unlocked = value == 0xA5;
+            break;
+        default:
+            break;
+    }
+    c->arg_index++;
+}
+
+static uint8_t ctrl_read(sim_ctrl_t *c)
+{
+    uint32_t idx = c->read_index++;
+
+    switch (c->cmd) {
+        case EPD_CMD_TEMPTR:
+            return idx == 0 ? (uint8_t)s_cfg.temperature : 0x00;
+        case 0xF0:
+            if (idx == 0) {
+                return 0x00;
+            }
+            return idx <= SIM_OTP_BYTES ? s_otp[idx - 1U] : 0xFF;
+        case 0x94:
+            if (idx == 0) {
+                return 0x00;
+            }
+            if (!c->otp_unlocked || idx > sizeof(s_cfg.pwr)) {
+                return 0x00;
+            }
+            return s_cfg.pwr[idx - 1U];
+        default:
+            return 0xFF;
+    }
+}
+
+void epd_bus_init(void)
+{
+    ensure_configured();
+    ESP_LOGI(TAG, "Simulated bus ready at %u Hz", (unsigned)s_clock_hz);
+}
+
+void epd_bus_reset(void)
+{
+    ensure_configured();
+    s_phase = SIM_PHASE_SETUP;
+    epd_bus_delay_ms(160);
+
+    for (int i = 0; i < 2; i++) {
+        sim_ctrl_t *c = &s_ctrl[i];
+        c->cmd = 0xFF;
+        c->arg_index = 0;
+        c->read_index = 0;
+        c->psr[0] = 0;
+        c->psr[1] = 0;
+        c->powered = false;
+        c->otp_unlocked = false;
+        c->asleep = false;
+        if (s_cfg.reset_clears_ram) {
+            c->ram_valid = false;
+        }
+    }
+    set_busy(s_cfg.busy_reset_ms);
+    ESP_LOGI("epd_bus", "Reset completed");
+}
+
+static uint32_t busy_timeout_ms(uint8_t cmd)
+{
+    switch (cmd) {
+        case EPD_CMD_POWER_ON:
+            return SIM_BUSY_TIMEOUT_POWER_ON_MS;
+        case EPD_CMD_REFRESH:
+            return SIM_BUSY_TIMEOUT_REFRESH_MS;
+        case EPD_CMD_POWER_OFF:
+            return SIM_BUSY_TIMEOUT_POWER_OFF_MS;
+        case EPD_CMD_TEMPTR:
+            return SIM_BUSY_TIMEOUT_TEMPTR_MS;
+        default:
+            return SIM_BUSY_TIMEOUT_DEFAULT_MS;
+    }
+}
+
+uint32_t epd_bus_wait_busy(uint8_t cmd)
+{
+    uint64_t timeout_ns = (uint64_t)busy_timeout_ms(cmd) * 1000000ULL;
+    uint64_t wait_ns = s_busy_until_ns > s_now_ns ? s_busy_until_ns - s_now_ns : 0;
+    bool timed_out = wait_ns > timeout_ns;
+
+    if (timed_out) {
+        wait_ns = timeout_ns;
+    }
+    s_stats[s_phase].busy_ns += wait_ns;
+    sim_advance_ns(wait_ns);
+
+    uint32_t elapsed_ms = (uint32_t)(wait_ns / 1000000ULL);
+    if (timed_out) {
+        s_errors++;
+        ESP_LOGW("epd_bus", "Busy signal timeout after %u ms (cmd 0x%02X)", (unsigned)elapsed_ms, cmd);
+    } else {
+        ESP_LOGI("epd_bus", "Busy signal cleared after %u ms (cmd 0x%02X)", (unsigned)elapsed_ms, cmd);
+    }
+    return elapsed_ms;
+}
+
+void epd_bus_delay_ms(uint32_t time_ms)
+{
+    sim_advance_ns((uint64_t)time_ms * 1000000ULL);
+}
+
+void epd_bus_delay_s(uint32_t time_s)
+{
+    epd_bus_delay_ms(time_s * 1000U);
+}
+
+void epd_bus_set_master_mode(bool high)
+{
+    // MS only selects which die drives the shared BUSY line.
+    (void)high;
+}
+
+void epd_bus_set_clock_hz(uint32_t hz)
+{
+    if (hz == 0) {
+        hz = SIM_DEFAULT_CLOCK_HZ;
+    }
+    if (hz == s_clock_hz) {
+        return;
+    }
+    if (s_stream_open) {
+        epd_bus_stream_end();
+    }
+    s_clock_hz = hz;
+    ESP_LOGI("epd_bus", "SPI clock set to %u Hz", (unsigned)s_clock_hz);
+}
+
+uint32_t epd_bus_get_clock_hz(void)
+{
+    return s_clock_hz;
+}
+
+uint32_t epd_bus_get_default_clock_hz(void)
+{
+    return SIM_DEFAULT_CLOCK_HZ;
+}
+
+void epd_bus_write_cmd(epd_ms_target_t target, uint8_t cmd)
+{
+    ensure_configured();
+    if (s_stream_open) {
+        sim_error("Command written inside an open %s stream", "data");
+        epd_bus_stream_end();
+    }
+
+    update_phase(target, cmd);
+    s_stats[s_phase].commands++;
+    sim_advance_ns(10000U + SIM_POLL_OVERHEAD_NS);
+    charge_wire(wire_ns(1));
+
+    for (int i = 0; i < 2; i++) {
+        if (targets(target, i)) {
+            ctrl_command(&s_ctrl[i], cmd);
+        }
+    }
+
+    switch (cmd) {
+        case EPD_CMD_POWER_ON:
+            set_busy(s_cfg.busy_power_on_ms);
+            break;
+        case EPD_CMD_REFRESH:
+            start_refresh();
+            set_busy(s_cfg.busy_refresh_ms);
+            break;
+        case EPD_CMD_POWER_OFF:
+            set_busy(s_cfg.busy_power_off_ms);
+            break;
+        case EPD_CMD_TEMPTR:
+            set_busy(s_cfg.busy_temptr_ms);
+            break;
+        default:
+            break;
+    }
+}
+
+void epd_bus_write_data(epd_ms_target_t target, uint8_t data)
+{
+    ensure_configured();
+    sim_advance_ns(10000U + SIM_POLL_OVERHEAD_NS);
+    charge_wire(wire_ns(1));
+    s_stats[s_phase].data_bytes++;
+
+    for (int i = 0; i < 2; i++) {
+        if (targets(target, i)) {
+            ctrl_data(&s_ctrl[i], data);
+        }
+    }
+}
+
+uint8_t epd_bus_read_data(epd_ms_target_t target)
+{
+    ensure_configured();
+    sim_advance_ns(9000U + SIM_POLL_OVERHEAD_NS);
+    charge_wire(wire_ns(1));
+    s_stats[s_phase].reads++;
+
+    if (!targets(target, 0)) {
+        return 0xFF;
+    }
+
+    uint8_t value = ctrl_read(&s_ctrl[0]);
+    if (s_clock_hz > s_cfg.max_read_hz) {
+        value ^= 0x01;
+    }
+    return value;
+}
+
+void epd_bus_stream_begin(epd_ms_target_t target)
+{
+    ensure_configured();
+    if (s_stream_open) {
+        epd_bus_stream_end();
+    }
+    s_stream_target = target;
+    s_stream_open = true;
+    sim_advance_ns(3000U);
+}
+
+static void stream_bytes(const uint8_t *buf, uint8_t value, size_t len)
+{
+    for (int i = 0; i < 2; i++) {
+        if (!targets(s_stream_target, i)) {
+            continue;
+        }
+        for (size_t n = 0; n < len; n++) {
+            ctrl_data(&s_ctrl[i], buf ? buf[n] : value);
+        }
+    }
+    s_stats[s_phase].data_bytes += len;
+}
+
+void epd_bus_stream_write(const uint8_t *buf, size_t len)
+{
+    if (!s_stream_open || !buf) {
+        return;
+    }
+
+    while (len > 0) {
+        size_t chunk = len < SIM_CHUNK_SIZE ? len : SIM_CHUNK_SIZE;
+        sim_advance_ns(SIM_QUEUE_OVERHEAD_NS);
+        charge_wire(wire_ns(chunk));
+        stream_bytes(buf, 0, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+void epd_bus_stream_write_inplace(const uint8_t *buf, size_t len)
+{
+    // The host has no DMA-capable memory distinction; timing is the same.
+    epd_bus_stream_write(buf, len);
+}
+
+uint8_t *epd_bus_stream_acquire(size_t *capacity)
+{
+    static uint8_t chunk[SIM_CHUNK_SIZE];
+
+    if (!s_stream_open) {
+        return NULL;
+    }
+    *capacity = SIM_CHUNK_SIZE;
+    return chunk;
+}
+
+void epd_bus_stream_commit(size_t len)
+{
+    size_t capacity = 0;
+    uint8_t *chunk = epd_bus_stream_acquire(&capacity);
+
+    if (!chunk || len == 0 || len > capacity) {
+        return;
+    }
+    sim_advance_ns(SIM_QUEUE_OVERHEAD_NS);
+    charge_wire(wire_ns(len));
+    stream_bytes(chunk, 0, len);
+}
+
+void epd_bus_stream_fill(uint8_t value, size_t len)
+{
+    if (!s_stream_open) {
+        return;
+    }
+
+    while (len > 0) {
+        size_t chunk = len < SIM_FILL_SIZE ? len : SIM_FILL_SIZE;
+        sim_advance_ns(SIM_QUEUE_OVERHEAD_NS);
+        charge_wire(wire_ns(chunk));
+        stream_bytes(NULL, value, chunk);
+        len -= chunk;
+    }
+}
+
+void epd_bus_stream_end(void)
+{
+    if (!s_stream_open) {
+        return;
+    }
+    s_stream_open = false;
+    sim_advance_ns(4000U);
+}
+
+void epd_bus_write_data_buf(epd_ms_target_t target, const uint8_t *buf, size_t len)
+{
+    if (!buf || len == 0) {
+        return;
+    }
+
+    epd_bus_stream_begin(target);
+    epd_bus_stream_write(buf, len);
+    epd_bus_stream_end();
+}
@@ -0,0 +1,299 @@
+// Runs the real epd_169inch.c against the simulated bus and checks that the
+// image rebuilt from the controllers' data RAM matches the frame sent.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "epd_169inch.h"
+#include "epd_stats.h"
+#include "esp_log.h"
+#include "sim_panel.h"
+#include "sim_shim.h"
+
+static const char *TAG = "epd_sim";
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] frame.sp6|frame.sp6n [...]\n"
+            "  --out DIR            write <frame>.png files to DIR (default .)\n"
+            "  --no-png             skip PNG output\n"
+            "  --demo               run the stripe demo before the frames\n"
+            "  --native             send sp6 frames as native (SP6N) planes\n"
+            "  --source             feed frames through epd_show_source\n"
+            "  --stats              print the per-phase latency histograms at the end\n"
+            "  --nvs FILE           persist simulated NVS to FILE\n"
+            "  --busy-log FILE      take BUSY times from a device serial log\n"
+            "  --max-read-hz HZ     corrupt readback above this SPI clock\n"
+            "  --temperature C      on-die temperature sensor reading\n"
+            "  --reset-clears-ram   model data RAM loss on hardware reset\n"
+            "  --quiet              only log warnings and errors\n",
+            argv0);
+}
+
+static double cpu_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (ts.tv_sec * 1e3) + (ts.tv_nsec / 1e6);
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (buf && fread(buf, (size_t)size, 1, f) != 1) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = buf ? (size_t)size : 0;
+    return buf;
+}
+
+// Converts between the sp6 layout and the two controller planes; the same
+// transpose the driver does for sp6 frames.
+static void sp6_planes(uint8_t *sp6, uint8_t *planes, bool to_planes)
+{
+    uint8_t *master = planes;
+    uint8_t *slave = &planes[SIM_FRAME_BYTES / 2U];
+
+    for (size_t j = 0; j < SIM_FRAME_BYTES / 2U; j++) {
+        uint8_t *pair = &sp6[j * 2U];
+        if (to_planes) {
+            master[j] = (uint8_t)((pair[0] & 0xF0) | (pair[1] >> 4));
+            slave[j] = (uint8_t)(((pair[0] & 0x0F) << 4) | (pair[1] & 0x0F));
+        } else {
+            pair[0] = (uint8_t)((master[j] & 0xF0) | (slave[j] >> 4));
+            pair[1] = (uint8_t)(((master[j] & 0x0F) << 4) | (slave[j] & 0x0F));
+        }
+    }
+}
+
+static bool planes_source(void *ctx, unsigned plane, uint32_t offset, uint8_t *out, size_t len)
+{
+    const uint8_t *planes = ctx;
+    memcpy(out, &planes[(plane * (SIM_FRAME_BYTES / 2U)) + offset], len);
+    return true;
+}
+
+static void png_path(char *out, size_t out_len, const char *dir, const char *frame)
+{
+    const char *base = strrchr(frame, '/');
+    base = base ? base + 1 : frame;
+    const char *dot = strrchr(base, '.');
+    int stem = dot ? (int)(dot - base) : (int)strlen(base);
+    snprintf(out, out_len, "%s/%.*s.png", dir, stem, base);
+}
+
+static bool write_png(const char *dir, const char *name)
+{
+    char path[512];
+    png_path(path, sizeof(path), dir, name);
+    if (sim_png_write_sp6(path, sim_panel_displayed()) != 0) {
+        ESP_LOGE(TAG, "Failed to write %s", path);
+        return false;
+    }
+    ESP_LOGI(TAG, "Wrote %s", path);
+    return true;
+}
+
+static void print_report(const char *name, double host_ms)
+{
+    printf("\n== %s ==\n", name);
+    sim_stats_print(stdout);
+    printf("%-12s %10.1f\n", "host cpu", host_ms);
+}
+
+static void print_phase_stats(void)
+{
+    epd_stats_t stats;
+    epd_stats_get(&stats);
+
+    printf("\n== refresh phases (%u frames) ==\n", (unsigned)stats.frames);
+    printf("%-12s %6s %10s %10s %10s %10s\n", "phase", "count", "min ms", "p50 ms", "p99 ms",
+           "max ms");
+    for (int p = 0; p < EPD_PHASE_COUNT; p++) {
+        const epd_phase_hist_t *h = &stats.phases[p];
+        printf("%-12s %6u %10.1f %10.1f %10.1f %10.1f\n",
+               epd_stats_phase_name((epd_phase_t)p), (unsigned)h->count, h->min_us / 1e3,
+               epd_stats_percentile(h, 50) / 1e3, epd_stats_percentile(h, 99) / 1e3,
+               h->max_us / 1e3);
+    }
+}
+
+static int run_frame(const char *path, const char *out_dir, bool png, bool native, bool source)
+{
+    size_t len = 0;
+    uint8_t *data = load_file(path, &len);
+    const uint8_t *payload = NULL;
+    epd_frame_format_t format = EPD_FRAME_SP6;
+    if (!data) {
+        ESP_LOGE(TAG, "Cannot read %s", path);
+        return 1;
+    }
+    if (!epd_parse_frame(data, len, &payload, &format)) {
+        ESP_LOGE(TAG, "%s is neither an sp6 frame nor an SP6N container", path);
+        free(data);
+        return 1;
+    }
+
+    // frame is the expected picture in sp6 order, planes what gets sent.
+    static uint8_t frame[SIM_FRAME_BYTES];
+    static uint8_t planes[SIM_FRAME_BYTES];
+    memcpy(frame, payload, SIM_FRAME_BYTES);
+    if (format == EPD_FRAME_NATIVE) {
+        memcpy(planes, payload, SIM_FRAME_BYTES);
+        sp6_planes(frame, planes, false);
+    } else if (native || source) {
+        sp6_planes(frame, planes, true);
+        format = EPD_FRAME_NATIVE;
+    }
+    free(data);
+    len = SIM_FRAME_BYTES;
+
+    uint32_t refreshes = sim_panel_refresh_count();
+    uint32_t errors = sim_panel_error_count();
+    sim_stats_reset();
+    double start = cpu_ms();
+    epd_show_result_t result;
+    if (source) {
+        result = epd_show_source(planes_source, planes);
+    } else {
+        result = epd_show_frame(format == EPD_FRAME_NATIVE ? planes : frame, len, format);
+    }
+    double host_ms = cpu_ms() - start;
+    print_report(path, host_ms);
+
+    int rc = 0;
+    if (result == EPD_SHOW_UNCHANGED) {
+        printf("unchanged, refresh skipped\n");
+        if (sim_panel_refresh_count() != refreshes) {
+            ESP_LOGE(TAG, "%s: reported unchanged but the panel refreshed", path);
+            rc = 1;
+        }
+    } else if (sim_panel_refresh_count() == refreshes) {
+        ESP_LOGE(TAG, "%s: panel was not refreshed", path);
+        rc = 1;
+    } else if (memcmp(sim_panel_displayed(), frame, len) != 0) {
+        const uint8_t *shown = sim_panel_displayed();
+        size_t i = 0;
+        while (shown[i] == frame[i]) {
+            i++;
+        }
+        ESP_LOGE(TAG, "%s: displayed image differs at byte %u (0x%02X != 0x%02X)",
+                 path, (unsigned)i, shown[i], frame[i]);
+        rc = 1;
+    }
+    if (sim_panel_error_count() != errors) {
+        rc = 1;
+    }
+    if (png && !write_png(out_dir, path)) {
+        rc = 1;
+    }
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    sim_panel_config_t cfg;
+    const char *out_dir = ".";
+    const char *busy_log = NULL;
+    bool png = true;
+    bool demo = false;
+    bool native = false;
+    bool source = false;
+    bool stats = false;
+    int rc = 0;
+    int i;
+
+    sim_panel_default_config(&cfg);
+    for (i = 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(opt, "--no-png") == 0) {
+            png = false;
+        } else if (strcmp(opt, "--demo") == 0) {
+            demo = true;
+        } else if (strcmp(opt, "--native") == 0) {
+            native = true;
+        } else if (strcmp(opt, "--source") == 0) {
+            source = true;
+        } else if (strcmp(opt, "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(opt, "--reset-clears-ram") == 0) {
+            cfg.reset_clears_ram = true;
+        } else if (strcmp(opt, "--quiet") == 0) {
+            esp_log_level_set("*", ESP_LOG_WARN);
+        } else if (val && strcmp(opt, "--out") == 0) {
+            out_dir = val;
+            i++;
+        } else if (val && strcmp(opt, "--nvs") == 0) {
+            sim_nvs_set_path(val);
+            i++;
+        } else if (val && strcmp(opt, "--busy-log") == 0) {
+            busy_log = val;
+            i++;
+        } else if (val && strcmp(opt, "--max-read-hz") == 0) {
+            cfg.max_read_hz = (uint32_t)strtoul(val, NULL, 0);
+            i++;
+        } else if (val && strcmp(opt, "--temperature") == 0) {
+            cfg.temperature = (int8_t)strtol(val, NULL, 0);
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (i == argc && !demo) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (busy_log) {
+        int used = sim_panel_load_busy_log(&cfg, busy_log);
+        if (used < 0) {
+            ESP_LOGE(TAG, "Cannot read %s", busy_log);
+            return 2;
+        }
+        ESP_LOGI(TAG, "Took %d BUSY timings from %s", used, busy_log);
+    }
+    sim_panel_configure(&cfg);
+
+    sim_stats_reset();
+    double start = cpu_ms();
+    epd_setup();
+    print_report("setup", cpu_ms() - start);
+
+    if (demo) {
+        uint32_t errors = sim_panel_error_count();
+        sim_stats_reset();
+        start = cpu_ms();
+        epd_demo_run();
+        print_report("stripe demo", cpu_ms() - start);
+        if (sim_panel_error_count() != errors || (png && !write_png(out_dir, "stripes"))) {
+            rc = 1;
+        }
+    }
+
+    for (; i < argc; i++) {
+        rc |= run_frame(argv[i], out_dir, png, native, source);
+    }
+
+    if (stats) {
+        print_phase_stats();
+    }
+    if (sim_panel_error_count() > 0) {
+        ESP_LOGE(TAG, "%u protocol errors", (unsigned)sim_panel_error_count());
+    }
+    return rc;
+}
@@ -0,0 +1,65 @@
+#ifndef SIM_PANEL_H
+#define SIM_PANEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_FRAME_BYTES 80000U
+#define SIM_PLANE_BYTES 40000U
+
+typedef enum {
+    SIM_PHASE_SETUP = 0,
+    SIM_PHASE_XFER_MASTER,
+    SIM_PHASE_XFER_SLAVE,
+    SIM_PHASE_XFER_BOTH,
+    SIM_PHASE_POWER_ON,
+    SIM_PHASE_REFRESH,
+    SIM_PHASE_POWER_OFF,
+    SIM_PHASE_COUNT,
+} sim_phase_t;
+
+typedef struct {
+    uint64_t total_ns;
+    uint64_t wire_ns;
+    uint64_t busy_ns;
+    uint64_t data_bytes;
+    uint32_t commands;
+    uint32_t reads;
+} sim_phase_stats_t;
+
+typedef struct {
+    // BUSY low time per command, in milliseconds.
+    uint32_t busy_reset_ms;
+    uint32_t busy_power_on_ms;
+    uint32_t busy_refresh_ms;
+    uint32_t busy_power_off_ms;
+    uint32_t busy_temptr_ms;
+    // Reads above this SCL rate come back with a flipped bit.
+    uint32_t max_read_hz;
+    bool reset_clears_ram;
+    int8_t temperature;
+    uint8_t vcom;
+    uint8_t pwr[5];
+} sim_panel_config_t;
+
+void sim_panel_default_config(sim_panel_config_t *cfg);
+void sim_panel_configure(const sim_panel_config_t *cfg);
+// Reads "Busy signal cleared after N ms (cmd 0xXX)" lines from a device log
+// and replaces the configured BUSY times with the median per command.
+int sim_panel_load_busy_log(sim_panel_config_t *cfg, const char *path);
+
+uint64_t sim_now_ns(void);
+void sim_advance_ns(uint64_t ns);
+
+// The last refreshed image, rebuilt from both data RAMs in the 80000-byte
+// sp6 layout the driver was handed.
+const uint8_t *sim_panel_displayed(void);
+uint32_t sim_panel_refresh_count(void);
+uint32_t sim_panel_error_count(void);
+
+void sim_stats_reset(void);
+const sim_phase_stats_t *sim_stats_phase(sim_phase_t phase);
+void sim_stats_print(FILE *out);
+
+#endif
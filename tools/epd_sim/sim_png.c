@@ -0,0 +1,131 @@
+// Writes an sp6 frame as a 400x400 RGB PNG using stored (uncompressed)
+// deflate blocks, so the simulator needs no zlib.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_rom_crc.h"
+#include "sim_shim.h"
+
+#define PNG_W 400U
+#define PNG_H 400U
+#define PNG_ROW_BYTES (1U + (PNG_W * 3U))
+#define PNG_STORED_MAX 65535U
+
+static const uint8_t s_palette[16][3] = {
+    [0] = {0, 0, 0},
+    [1] = {255, 255, 255},
+    [2] = {255, 220, 0},
+    [3] = {200, 0, 0},
+    [5] = {0, 60, 200},
+    [6] = {0, 150, 60},
+};
+
+static void put_u32be(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static int write_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t hdr[8];
+    uint8_t crc_buf[4];
+
+    put_u32be(hdr, len);
+    memcpy(&hdr[4], type, 4);
+    uint32_t crc = esp_rom_crc32_le(0, &hdr[4], 4);
+    crc = esp_rom_crc32_le(crc, data, len);
+    put_u32be(crc_buf, crc);
+
+    if (fwrite(hdr, sizeof(hdr), 1, f) != 1 ||
+        (len > 0 && fwrite(data, len, 1, f) != 1) ||
+        fwrite(crc_buf, sizeof(crc_buf), 1, f) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+static void pixel_rgb(const uint8_t *sp6, uint32_t x, uint32_t y, uint8_t *rgb)
+{
+    uint8_t b = sp6[((y * PNG_W) + x) / 2U];
+    uint8_t code = (x & 1U) ? (b & 0x0F) : (b >> 4);
+    // Codes outside the panel palette show up as magenta.
+    if (code == 4 || code > 6) {
+        rgb[0] = 255;
+        rgb[1] = 0;
+        rgb[2] = 255;
+        return;
+    }
+    memcpy(rgb, s_palette[code], 3);
+}
+
+int sim_png_write_sp6(const char *path, const uint8_t *sp6)
+{
+    static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    const uint32_t raw_len = PNG_ROW_BYTES * PNG_H;
+    const uint32_t blocks = (raw_len + PNG_STORED_MAX - 1U) / PNG_STORED_MAX;
+    const uint32_t z_len = 2U + raw_len + (blocks * 5U) + 4U;
+    uint8_t ihdr[13] = {0};
+    int rc = -1;
+
+    uint8_t *raw = malloc(raw_len);
+    uint8_t *z = malloc(z_len);
+    FILE *f = fopen(path, "wb");
+    if (!raw || !z || !f) {
+        goto out;
+    }
+
+    for (uint32_t y = 0; y < PNG_H; y++) {
+        uint8_t *row = &raw[y * PNG_ROW_BYTES];
+        row[0] = 0;
+        for (uint32_t x = 0; x < PNG_W; x++) {
+            pixel_rgb(sp6, x, y, &row[1U + (x * 3U)]);
+        }
+    }
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint32_t i = 0; i < raw_len; i++) {
+        a = (a + raw[i]) % 65521U;
+        b = (b + a) % 65521U;
+    }
+
+    uint8_t *p = z;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for (uint32_t off = 0; off < raw_len; off += PNG_STORED_MAX) {
+        uint32_t n = raw_len - off < PNG_STORED_MAX ? raw_len - off : PNG_STORED_MAX;
+        *p++ = off + n == raw_len ? 1 : 0;
+        *p++ = (uint8_t)n;
+        *p++ = (uint8_t)(n >> 8);
+        *p++ = (uint8_t)~n;
+        *p++ = (uint8_t)(~n >> 8);
+        memcpy(p, &raw[off], n);
+        p += n;
+    }
+    put_u32be(p, (b << 16) | a);
+
+    put_u32be(&ihdr[0], PNG_W);
+    put_u32be(&ihdr[4], PNG_H);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+
+    if (fwrite(sig, sizeof(sig), 1, f) == 1 &&
+        write_chunk(f, "IHDR", ihdr, sizeof(ihdr)) == 0 &&
+        write_chunk(f, "IDAT", z, z_len) == 0 &&
+        write_chunk(f, "IEND", NULL, 0) == 0) {
+        rc = 0;
+    }
+
+out:
+    if (f && fclose(f) != 0) {
+        rc = -1;
+    }
+    free(z);
+    free(raw);
+    return rc;
+}
@@ -0,0 +1,256 @@
+// Minimal host stand-ins for the IDF services the EPD driver links against:
+// logging, ROM CRC32, esp_timer, vTaskDelay and an in-memory NVS that can be
+// persisted to a file between runs.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim_panel.h"
+#include "sim_shim.h"
+
+#define SIM_NVS_ENTRIES 32
+#define SIM_NVS_NAME_LEN 16
+#define SIM_NVS_BLOB_MAX 4096
+#define SIM_NVS_HANDLES 8
+
+typedef struct {
+    char ns[SIM_NVS_NAME_LEN];
+    char key[SIM_NVS_NAME_LEN];
+    uint32_t len;
+    uint8_t data[SIM_NVS_BLOB_MAX];
+} sim_nvs_entry_t;
+
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+static sim_nvs_entry_t s_nvs[SIM_NVS_ENTRIES];
+static char s_nvs_open_ns[SIM_NVS_HANDLES][SIM_NVS_NAME_LEN];
+static const char *s_nvs_path;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    s_log_level = level;
+}
+
+void sim_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    static const char letters[] = "?EWIDV";
+    va_list args;
+
+    if (level > s_log_level) {
+        return;
+    }
+
+    FILE *out = level <= ESP_LOG_WARN ? stderr : stdout;
+    fprintf(out, "%c (%llu) %s: ", letters[level], (unsigned long long)(sim_now_ns() / 1000000ULL), tag);
+    va_start(args, fmt);
+    vfprintf(out, fmt, args);
+    va_end(args);
+    fputc('\n', out);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_INVALID_LENGTH:
+            return "ESP_ERR_NVS_INVALID_LENGTH";
+        default:
+            return "ESP_FAIL";
+    }
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    static uint32_t table[256];
+
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++) {
+                c = (c >> 1) ^ (0xEDB88320U & (0U - (c & 1U)));
+            }
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc = (crc >> 8) ^ table[(crc ^ buf[i]) & 0xFFU];
+    }
+    return ~crc;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)(sim_now_ns() / 1000ULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_advance_ns((uint64_t)ticks * portTICK_PERIOD_MS * 1000000ULL);
+}
+
+void sim_nvs_set_path(const char *path)
+{
+    s_nvs_path = path;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    if (!s_nvs_path) {
+        return ESP_OK;
+    }
+
+    FILE *f = fopen(s_nvs_path, "rb");
+    if (!f) {
+        return ESP_OK;
+    }
+    if (fread(s_nvs, sizeof(s_nvs), 1, f) != 1) {
+        memset(s_nvs, 0, sizeof(s_nvs));
+    }
+    fclose(f);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(s_nvs, 0, sizeof(s_nvs));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    (void)open_mode;
+    for (nvs_handle_t h = 0; h < SIM_NVS_HANDLES; h++) {
+        if (s_nvs_open_ns[h][0] == '\0') {
+            strncpy(s_nvs_open_ns[h], name, SIM_NVS_NAME_LEN - 1);
+            *out_handle = h + 1U;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle > 0 && handle <= SIM_NVS_HANDLES) {
+        s_nvs_open_ns[handle - 1U][0] = '\0';
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    if (!s_nvs_path) {
+        return ESP_OK;
+    }
+
+    FILE *f = fopen(s_nvs_path, "wb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    size_t written = fwrite(s_nvs, sizeof(s_nvs), 1, f);
+    fclose(f);
+    return written == 1 ? ESP_OK : ESP_FAIL;
+}
+
+static sim_nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key, bool create)
+{
+    if (handle == 0 || handle > SIM_NVS_HANDLES) {
+        return NULL;
+    }
+
+    const char *ns = s_nvs_open_ns[handle - 1U];
+    sim_nvs_entry_t *free_slot = NULL;
+    for (int i = 0; i < SIM_NVS_ENTRIES; i++) {
+        sim_nvs_entry_t *e = &s_nvs[i];
+        if (e->key[0] == '\0') {
+            if (!free_slot) {
+                free_slot = e;
+            }
+            continue;
+        }
+        if (strcmp(e->ns, ns) == 0 && strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    if (create && free_slot) {
+        strncpy(free_slot->ns, ns, SIM_NVS_NAME_LEN - 1);
+        strncpy(free_slot->key, key, SIM_NVS_NAME_LEN - 1);
+        free_slot->len = 0;
+        return free_slot;
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    sim_nvs_entry_t *e = nvs_find(handle, key, false);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (!out_value) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, e->data, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    if (length > SIM_NVS_BLOB_MAX) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    sim_nvs_entry_t *e = nvs_find(handle, key, true);
+    if (!e) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(e->data, value, length);
+    e->len = (uint32_t)length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get_blob(handle, key, out_value, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    sim_nvs_entry_t *e = nvs_find(handle, key, false);
+    if (!e) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
@@ -0,0 +1,12 @@
+#ifndef SIM_SHIM_H
+#define SIM_SHIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Persist the simulated NVS partition to this file; NULL keeps it in memory.
+void sim_nvs_set_path(const char *path);
+
+int sim_png_write_sp6(const char *path, const uint8_t *sp6);
+
+#endif
@@ -0,0 +1,72 @@
+// One heatshrink decode driven the way the upload handler drives it: input in
+// fixed-size pieces, each followed by polls into an output window of a fixed
+// size. Included by both decoder builds so they run the same loop.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heatshrink_decoder.h"
+
+#define DECODE_INPUT_BUFFER 256
+
+static bool decode_loop(const uint8_t *in, size_t in_len, uint8_t window_bits,
+                        uint8_t lookahead_bits, size_t in_chunk, size_t out_chunk, uint8_t *out,
+                        size_t out_cap, size_t *out_len, bool *done)
+{
+    heatshrink_decoder *hsd =
+        heatshrink_decoder_alloc(DECODE_INPUT_BUFFER, window_bits, lookahead_bits);
+    if (!hsd) {
+        return false;
+    }
+
+    size_t pos = 0;
+    size_t produced = 0;
+    bool ok = true;
+    while (ok && pos < in_len) {
+        size_t piece = in_len - pos < in_chunk ? in_len - pos : in_chunk;
+        size_t end = pos + piece;
+        while (ok && pos < end) {
+            size_t sunk = 0;
+            if (heatshrink_decoder_sink(hsd, (uint8_t *)&in[pos], end - pos, &sunk) < 0) {
+                ok = false;
+                break;
+            }
+            pos += sunk;
+            HSD_poll_res pres;
+            do {
+                size_t room = out_cap - produced < out_chunk ? out_cap - produced : out_chunk;
+                size_t got = 0;
+                pres = heatshrink_decoder_poll(hsd, &out[produced], room, &got);
+                produced += got;
+                if (pres < 0 || (pres == HSDR_POLL_MORE && produced == out_cap)) {
+                    ok = false;
+                }
+            } while (ok && pres == HSDR_POLL_MORE);
+        }
+    }
+
+    *done = false;
+    while (ok) {
+        HSD_finish_res fres = heatshrink_decoder_finish(hsd);
+        if (fres == HSDR_FINISH_DONE) {
+            *done = true;
+            break;
+        }
+        if (fres != HSDR_FINISH_MORE) {
+            ok = false;
+            break;
+        }
+        size_t room = out_cap - produced < out_chunk ? out_cap - produced : out_chunk;
+        size_t got = 0;
+        if (room == 0 || heatshrink_decoder_poll(hsd, &out[produced], room, &got) < 0) {
+            ok = false;
+            break;
+        }
+        produced += got;
+    }
+
+    heatshrink_decoder_free(hsd);
+    *out_len = produced;
+    return ok;
+}
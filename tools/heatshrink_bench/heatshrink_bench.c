@@ -0,0 +1,219 @@
+// Checks the heatshrink decoder in third_party/ against the unmodified upstream
+// one (reference/) and times both. Every input file is compressed over a grid
+// of window/lookahead sizes; each stream must decode back to the file, and to
+// the same bytes and finish state as the reference, for every input piece and
+// output window size, including truncated streams.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decode_loop.h"
+#include "heatshrink_encoder.h"
+#include "ref_decode.h"
+
+#define BENCH_CHUNK 512
+#define BENCH_DEFAULT_ITERATIONS 20
+
+static const size_t s_in_chunks[] = {1, 3, 64, 512, 1 << 20};
+static const size_t s_out_chunks[] = {1, 7, 512, 1 << 20};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [options] file [...]\n"
+            "  --check              only compare the decoders, no timing\n"
+            "  --iterations N       decodes per timed run (default %d)\n",
+            argv0, BENCH_DEFAULT_ITERATIONS);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e3) + (ts.tv_nsec / 1e6);
+}
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (buf && fread(buf, (size_t)size, 1, f) != 1) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = buf ? (size_t)size : 0;
+    return buf;
+}
+
+static uint8_t *encode(const uint8_t *in, size_t in_len, uint8_t window_bits,
+                       uint8_t lookahead_bits, size_t *out_len)
+{
+    heatshrink_encoder *hse = heatshrink_encoder_alloc(window_bits, lookahead_bits);
+    size_t cap = in_len + (in_len / 8U) + 64U;
+    uint8_t *out = malloc(cap);
+    if (!hse || !out) {
+        heatshrink_encoder_free(hse);
+        free(out);
+        return NULL;
+    }
+
+    size_t pos = 0;
+    size_t produced = 0;
+    for (;;) {
+        if (pos < in_len) {
+            size_t sunk = 0;
+            heatshrink_encoder_sink(hse, (uint8_t *)&in[pos], in_len - pos, &sunk);
+            pos += sunk;
+        } else if (heatshrink_encoder_finish(hse) == HSER_FINISH_DONE) {
+            break;
+        }
+        HSE_poll_res pres;
+        do {
+            size_t got = 0;
+            pres = heatshrink_encoder_poll(hse, &out[produced], cap - produced, &got);
+            produced += got;
+        } while (pres == HSER_POLL_MORE);
+    }
+
+    heatshrink_encoder_free(hse);
+    *out_len = produced;
+    return out;
+}
+
+// Truncated streams run the coarser sizes only: the cut is what they test.
+static bool compare(const char *name, const uint8_t *stream, size_t stream_len,
+                    const uint8_t *expect, size_t expect_len, uint8_t w, uint8_t l,
+                    uint8_t *out, uint8_t *ref_out, size_t cap)
+{
+    bool ok = true;
+    size_t skip = expect ? 0 : 1;
+    for (size_t i = skip; i < sizeof(s_in_chunks) / sizeof(s_in_chunks[0]); i++) {
+        for (size_t o = skip; o < sizeof(s_out_chunks) / sizeof(s_out_chunks[0]); o++) {
+            size_t len = 0;
+            size_t ref_len = 0;
+            bool done = false;
+            bool ref_done = false;
+            bool res = decode_loop(stream, stream_len, w, l, s_in_chunks[i], s_out_chunks[o], out,
+                                   cap, &len, &done);
+            bool ref_res = ref_decode(stream, stream_len, w, l, s_in_chunks[i], s_out_chunks[o],
+                                      ref_out, cap, &ref_len, &ref_done);
+            const char *why = NULL;
+            if (res != ref_res || done != ref_done || len != ref_len ||
+                memcmp(out, ref_out, len) != 0) {
+                why = "differs from the reference";
+            } else if (expect && (len != expect_len || memcmp(out, expect, len) != 0)) {
+                why = "does not round trip";
+            }
+            if (why) {
+                fprintf(stderr, "%s w%u l%u in %zu out %zu (%zu bytes): %s\n", name, w, l,
+                        s_in_chunks[i], s_out_chunks[o], stream_len, why);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static double time_decode(bool reference, const uint8_t *stream, size_t stream_len, uint8_t w,
+                          uint8_t l, uint8_t *out, size_t cap, int iterations)
+{
+    double start = now_ms();
+    for (int it = 0; it < iterations; it++) {
+        size_t len = 0;
+        bool done = false;
+        if (reference) {
+            ref_decode(stream, stream_len, w, l, BENCH_CHUNK, BENCH_CHUNK, out, cap, &len, &done);
+        } else {
+            decode_loop(stream, stream_len, w, l, BENCH_CHUNK, BENCH_CHUNK, out, cap, &len, &done);
+        }
+    }
+    return (now_ms() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    bool check_only = false;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strcmp(argv[first], "--check") == 0) {
+            check_only = true;
+        } else if (strcmp(argv[first], "--iterations") == 0 && first + 1 < argc) {
+            iterations = atoi(argv[++first]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (first == argc || iterations <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    double total_ms = 0;
+    double total_ref_ms = 0;
+    for (int a = first; a < argc; a++) {
+        size_t in_len = 0;
+        uint8_t *in = load_file(argv[a], &in_len);
+        if (!in) {
+            fprintf(stderr, "%s: cannot read\n", argv[a]);
+            ok = false;
+            continue;
+        }
+        size_t cap = in_len + 1U;
+        uint8_t *out = malloc(cap);
+        uint8_t *ref_out = malloc(cap);
+
+        for (uint8_t w = 8; w <= 12; w++) {
+            const uint8_t lookaheads[] = {3, 4, (uint8_t)(w - 1)};
+            for (size_t li = 0; li < sizeof(lookaheads); li++) {
+                uint8_t l = lookaheads[li];
+                size_t stream_len = 0;
+                uint8_t *stream = encode(in, in_len, w, l, &stream_len);
+                if (!stream) {
+                    fprintf(stderr, "%s w%u l%u: encode failed\n", argv[a], w, l);
+                    ok = false;
+                    continue;
+                }
+                ok &= compare(argv[a], stream, stream_len, in, in_len, w, l, out, ref_out, cap);
+                // Truncated streams only have to agree with the reference.
+                for (size_t cut = 1; cut < stream_len; cut *= 7) {
+                    ok &= compare(argv[a], stream, stream_len - cut, NULL, 0, w, l, out, ref_out,
+                                  cap);
+                }
+
+                if (!check_only && l == 4) {
+                    double ms = time_decode(false, stream, stream_len, w, l, out, cap, iterations);
+                    double ref_ms =
+                        time_decode(true, stream, stream_len, w, l, ref_out, cap, iterations);
+                    total_ms += ms;
+                    total_ref_ms += ref_ms;
+                    printf("%-40s w%-2u l%u %7zu -> %7zu  %8.3f ms  reference %8.3f ms  x%.2f\n",
+                           argv[a], w, l, stream_len, in_len, ms, ref_ms, ref_ms / ms);
+                }
+                free(stream);
+            }
+        }
+        free(out);
+        free(ref_out);
+        free(in);
+    }
+
+    if (!check_only && total_ms > 0) {
+        printf("total %.3f ms, reference %.3f ms, x%.2f\n", total_ms, total_ref_ms,
+               total_ref_ms / total_ms);
+    }
+    printf("%s\n", ok ? "decoders agree" : "MISMATCH");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+// The unmodified upstream decoder (reference/), built with its public names
+// prefixed so it links next to the one in third_party/heatshrink.
+
+#include "ref_decode.h"
+
+// Shares the include guard, so decode_loop.h sees this header, not the new one.
+#include "reference/heatshrink_decoder.h"
+#include "decode_loop.h"
+
+bool ref_decode(const uint8_t *in, size_t in_len, uint8_t window_bits, uint8_t lookahead_bits,
+                size_t in_chunk, size_t out_chunk, uint8_t *out, size_t out_cap, size_t *out_len,
+                bool *done)
+{
+    return decode_loop(in, in_len, window_bits, lookahead_bits, in_chunk, out_chunk, out, out_cap,
+                       out_len, done);
+}
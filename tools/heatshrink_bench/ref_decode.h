@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+bool ref_decode(const uint8_t *in, size_t in_len, uint8_t window_bits, uint8_t lookahead_bits,
+                size_t in_chunk, size_t out_chunk, uint8_t *out, size_t out_cap, size_t *out_len,
+                bool *done);
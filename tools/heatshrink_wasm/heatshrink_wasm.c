@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "heatshrink_encoder.h"
 
 #ifdef __EMSCRIPTEN__
@@ -17,13 +18,38 @@ HS_KEEP void hs_free(void *ptr) {
     free(ptr);
 }
 
-HS_KEEP uint32_t hs_encode(const uint8_t *input, uint32_t input_len,
-                           uint8_t *output, uint32_t output_cap,
-                           uint8_t window_bits, uint8_t lookahead_bits) {
-    if (!input || !output || output_cap == 0) {
-        return 0;
+// hs_encode() with window_bits 0 tries every setting the device decodes
+// (UPLOAD_HS_MAX_WINDOW_BITS in main/config.h) and keeps the smallest output.
+#define HS_AUTO_MIN_WINDOW_BITS 8
+#define HS_AUTO_MAX_WINDOW_BITS 12
+#define HS_AUTO_MIN_LOOKAHEAD_BITS 3
+
+static uint8_t s_last_window_bits;
+static uint8_t s_last_lookahead_bits;
+
+static int drain(heatshrink_encoder *enc, uint8_t *output, uint32_t output_cap,
+                 uint32_t *out_pos) {
+    while (1) {
+        size_t polled = 0;
+        if (*out_pos >= output_cap) {
+            return -1;
+        }
+        HSE_poll_res poll_res = heatshrink_encoder_poll(enc, output + *out_pos,
+            output_cap - *out_pos, &polled);
+        *out_pos += (uint32_t)polled;
+        if (poll_res == HSER_POLL_MORE) {
+            continue;
+        }
+        if (poll_res == HSER_POLL_EMPTY) {
+            return 0;
+        }
+        return -1;
     }
+}
 
+static uint32_t encode_once(const uint8_t *input, uint32_t input_len,
+                            uint8_t *output, uint32_t output_cap,
+                            uint8_t window_bits, uint8_t lookahead_bits) {
     heatshrink_encoder *enc = heatshrink_encoder_alloc(window_bits, lookahead_bits);
     if (!enc) {
         return 0;
@@ -36,32 +62,11 @@ HS_KEEP uint32_t hs_encode(const uint8_t *input, uint32_t input_len,
         size_t sunk = 0;
         HSE_sink_res sink_res = heatshrink_encoder_sink(enc,
             (uint8_t *)(input + in_pos), input_len - in_pos, &sunk);
-        if (sink_res < 0) {
+        if (sink_res < 0 || drain(enc, output, output_cap, &out_pos) < 0) {
             heatshrink_encoder_free(enc);
             return 0;
         }
         in_pos += (uint32_t)sunk;
-
-        while (1) {
-            size_t polled = 0;
-            if (out_pos >= output_cap) {
-                heatshrink_encoder_free(enc);
-                return 0;
-            }
-            HSE_poll_res poll_res = heatshrink_encoder_poll(enc, output + out_pos,
-                output_cap - out_pos, &polled);
-            out_pos += (uint32_t)polled;
-            if (poll_res == HSER_POLL_MORE) {
-                continue;
-            }
-            if (poll_res == HSER_POLL_EMPTY) {
-                break;
-            }
-            if (poll_res < 0) {
-                heatshrink_encoder_free(enc);
-                return 0;
-            }
-        }
     }
 
     while (1) {
@@ -69,33 +74,54 @@ HS_KEEP uint32_t hs_encode(const uint8_t *input, uint32_t input_len,
         if (finish_res == HSER_FINISH_DONE) {
             break;
         }
-        if (finish_res < 0) {
+        if (finish_res < 0 || drain(enc, output, output_cap, &out_pos) < 0) {
             heatshrink_encoder_free(enc);
             return 0;
         }
+    }
 
-        while (1) {
-            size_t polled = 0;
-            if (out_pos >= output_cap) {
-                heatshrink_encoder_free(enc);
-                return 0;
-            }
-            HSE_poll_res poll_res = heatshrink_encoder_poll(enc, output + out_pos,
-                output_cap - out_pos, &polled);
-            out_pos += (uint32_t)polled;
-            if (poll_res == HSER_POLL_MORE) {
-                continue;
-            }
-            if (poll_res == HSER_POLL_EMPTY) {
-                break;
-            }
-            if (poll_res < 0) {
-                heatshrink_encoder_free(enc);
-                return 0;
+    heatshrink_encoder_free(enc);
+    return out_pos;
+}
+
+HS_KEEP uint32_t hs_encode(const uint8_t *input, uint32_t input_len,
+                           uint8_t *output, uint32_t output_cap,
+                           uint8_t window_bits, uint8_t lookahead_bits) {
+    if (!input || !output || output_cap == 0) {
+        return 0;
+    }
+    if (window_bits != 0) {
+        uint32_t size = encode_once(input, input_len, output, output_cap,
+                                    window_bits, lookahead_bits);
+        if (size > 0) {
+            s_last_window_bits = window_bits;
+            s_last_lookahead_bits = lookahead_bits;
+        }
+        return size;
+    }
+
+    uint8_t *scratch = malloc(output_cap);
+    if (!scratch) {
+        return 0;
+    }
+    uint32_t best = 0;
+    for (uint8_t w = HS_AUTO_MIN_WINDOW_BITS; w <= HS_AUTO_MAX_WINDOW_BITS; w++) {
+        for (uint8_t l = HS_AUTO_MIN_LOOKAHEAD_BITS; l < w; l++) {
+            uint32_t size = encode_once(input, input_len, scratch, output_cap, w, l);
+            if (size > 0 && (best == 0 || size < best)) {
+                memcpy(output, scratch, size);
+                best = size;
+                s_last_window_bits = w;
+                s_last_lookahead_bits = l;
             }
         }
     }
+    free(scratch);
+    return best;
+}
 
-    heatshrink_encoder_free(enc);
-    return out_pos;
+// Settings of the last successful hs_encode(): window bits << 8 | lookahead
+// bits, which is what an auto encode has to put in the HSK1 header.
+HS_KEEP uint32_t hs_last_params(void) {
+    return ((uint32_t)s_last_window_bits << 8) | s_last_lookahead_bits;
 }
@@ -0,0 +1,117 @@
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#define HS_KEEP EMSCRIPTEN_KEEPALIVE
+#else
+#define HS_KEEP
+#endif
+
+// SP6C encoder, the counterpart of the decoder in main/image_upload.c and of
+// encode_sp6c() in tools/upload_image.py. Every 3-bit pixel is range coded
+// MSB first down a 7-node tree picked by its left, upper and upper-left
+// neighbours.
+
+#define SP6C_CONTEXTS 512U
+#define SP6C_PROB_BITS 11U
+#define SP6C_MOVE_BITS 4U
+#define SP6C_TOP (1UL << 24)
+
+typedef struct {
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint32_t cache_size;
+    uint8_t *out;
+    uint32_t out_len;
+    uint32_t out_cap;
+    int overflow;
+} sp6c_encoder;
+
+static uint16_t s_probs[SP6C_CONTEXTS][7];
+
+static void shift_low(sp6c_encoder *e)
+{
+    if (e->low < 0xFF000000ULL || e->low >= (1ULL << 32)) {
+        uint8_t carry = (uint8_t)(e->low >> 32);
+        uint8_t temp = e->cache;
+        do {
+            if (e->out_len == e->out_cap) {
+                e->overflow = 1;
+            } else {
+                e->out[e->out_len++] = (uint8_t)(temp + carry);
+            }
+            temp = 0xFF;
+        } while (--e->cache_size != 0);
+        e->cache = (uint8_t)(e->low >> 24);
+    }
+    e->cache_size++;
+    e->low = (e->low & 0x00FFFFFFULL) << 8;
+}
+
+static void encode_bit(sp6c_encoder *e, uint16_t *prob, unsigned bit)
+{
+    uint32_t bound = (e->range >> SP6C_PROB_BITS) * *prob;
+    if (bit == 0) {
+        e->range = bound;
+        *prob += ((1U << SP6C_PROB_BITS) - *prob) >> SP6C_MOVE_BITS;
+    } else {
+        e->low += bound;
+        e->range -= bound;
+        *prob -= *prob >> SP6C_MOVE_BITS;
+    }
+    while (e->range < SP6C_TOP) {
+        e->range <<= 8;
+        shift_low(e);
+    }
+}
+
+static uint8_t pixel_at(const uint8_t *frame, uint32_t i)
+{
+    return (i & 1U) ? (frame[i >> 1] & 0x0F) : (frame[i >> 1] >> 4);
+}
+
+// Codes the frame bytes (no container header) and returns the payload size,
+// or 0 if a pixel is above 7 or the output does not fit.
+HS_KEEP uint32_t sp6c_encode(const uint8_t *frame, uint32_t frame_len, uint32_t stride,
+                             uint8_t *output, uint32_t output_cap)
+{
+    if (!frame || !output || stride == 0) {
+        return 0;
+    }
+
+    for (uint32_t c = 0; c < SP6C_CONTEXTS; c++) {
+        for (uint32_t n = 0; n < 7U; n++) {
+            s_probs[c][n] = 1U << (SP6C_PROB_BITS - 1U);
+        }
+    }
+    sp6c_encoder e;
+    memset(&e, 0, sizeof(e));
+    e.range = 0xFFFFFFFFU;
+    e.cache_size = 1;
+    e.out = output;
+    e.out_cap = output_cap;
+
+    uint32_t pixels = frame_len * 2U;
+    for (uint32_t i = 0; i < pixels; i++) {
+        uint8_t value = pixel_at(frame, i);
+        if (value > 7U) {
+            return 0;
+        }
+        uint32_t left = i >= 1U ? pixel_at(frame, i - 1U) : 0;
+        uint32_t up = i >= stride ? pixel_at(frame, i - stride) : 0;
+        uint32_t up_left = i >= stride + 1U ? pixel_at(frame, i - stride - 1U) : 0;
+        uint16_t *probs = s_probs[(left << 6) | (up << 3) | up_left];
+        unsigned node = 1;
+        for (int shift = 2; shift >= 0; shift--) {
+            unsigned bit = (value >> shift) & 1U;
+            encode_bit(&e, &probs[node - 1U], bit);
+            node = (node << 1) | bit;
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        shift_low(&e);
+    }
+    return e.overflow ? 0 : e.out_len;
+}
@@ -3,6 +3,13 @@
 
 Output format matches Send_HV_Stripe_imageData: column-major, 4bpp, with
 upper-half pixels in high nibbles and lower-half pixels in low nibbles.
+
+The sp6n packing is the "SP6N" container: magic, little-endian payload size,
+then the master and slave controller planes in the order the driver sends
+them, so the device streams them without transposing.
+
+--pack3 wraps either in "SP6P": the six colour codes fit in 3 bits, so 8
+pixels go in 3 bytes and the frame shrinks to 60000 bytes.
 """
 
 from __future__ import annotations
@@ -13,6 +20,10 @@ from typing import Iterable, List, Tuple
 
 from PIL import Image
 
+from upload_image import pack_sp6p
+
+
+SP6N_MAGIC = b"SP6N"
 
 PALETTE = [
     ("black", (0, 0, 0), 0x0),
@@ -117,7 +128,26 @@ def apply_round_mask(img: Image.Image) -> None:
                 pixels[x, y] = (255, 255, 255)
 
 
+def sp6_to_native(sp6: bytes) -> bytearray:
+    """Split an sp6 frame into the master (high nibbles) and slave planes."""
+    plane_len = len(sp6) // 2
+    master = bytearray(plane_len)
+    slave = bytearray(plane_len)
+    for j in range(plane_len):
+        a = sp6[2 * j]
+        b = sp6[2 * j + 1]
+        master[j] = (a & 0xF0) | (b >> 4)
+        slave[j] = ((a & 0x0F) << 4) | (b & 0x0F)
+    out = bytearray(SP6N_MAGIC)
+    out.extend(len(sp6).to_bytes(4, "little"))
+    out.extend(master)
+    out.extend(slave)
+    return out
+
+
 def image_to_bytes(img: Image.Image, dither: bool, packing: str, green_boost: float) -> bytearray:
+    if packing == "sp6n":
+        return sp6_to_native(image_to_bytes(img, dither, "sp6", green_boost))
     size = img.size[0]
     if size % 2 != 0:
         raise ValueError("Image size must be even")
@@ -207,9 +237,14 @@ def main() -> int:
     )
     parser.add_argument(
         "--packing",
-        choices=["nibble", "byte", "sp6"],
+        choices=["nibble", "byte", "sp6", "sp6n"],
         default="sp6",
-        help="Output packing: sp6 (default), nibble, or byte (0x11/0x22/etc)",
+        help="Output packing: sp6 (default), sp6n (controller planes), nibble, or byte (0x11/0x22/etc)",
+    )
+    parser.add_argument(
+        "--pack3",
+        action="store_true",
+        help="Wrap sp6/sp6n output in SP6P (3 bits per pixel) for upload or storage",
     )
     parser.add_argument(
         "--output-format",
@@ -245,8 +280,14 @@ def main() -> int:
     expected = args.size * args.size // 2
     if args.packing == "byte":
         expected = args.size * args.size
+    elif args.packing == "sp6n":
+        expected += len(SP6N_MAGIC) + 4
     if len(data) != expected:
         raise RuntimeError(f"Unexpected output size: {len(data)} (expected {expected})")
+    if args.pack3:
+        if args.packing not in ("sp6", "sp6n"):
+            raise RuntimeError("--pack3 needs --packing sp6 or sp6n")
+        data = pack_sp6p(data)
 
     output_path = Path(args.output)
     if args.output_format == "raw":
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Write upload test cases for upload_decoder_test.
+
+Each sp6 file is also turned into an SP6N container, and both are encoded as
+raw, SP6R, SP6V, SP6P and SP6C bodies with the encoders in upload_image.py.
+cases.txt lists one "<body> <expected frame>" pair per line.
+"""
+
+from __future__ import annotations
+
+import sys
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent.parent))
+
+from upload_image import (  # noqa: E402
+    SP6N_MAGIC,
+    encode_sp6c,
+    pack_sp6p,
+    rle2_encode_sp6_nibbles,
+    rle_encode_sp6_nibbles,
+)
+
+CODECS = {
+    "raw": bytes,
+    "sp6r": rle_encode_sp6_nibbles,
+    "sp6v": rle2_encode_sp6_nibbles,
+    "sp6p": pack_sp6p,
+    "sp6c": encode_sp6c,
+}
+
+
+def sp6_to_native(sp6: bytes) -> bytes:
+    """Same split as image_to_epd.py, which needs PIL to import."""
+    master = bytearray(len(sp6) // 2)
+    slave = bytearray(len(sp6) // 2)
+    for j in range(len(master)):
+        a, b = sp6[2 * j], sp6[2 * j + 1]
+        master[j] = (a & 0xF0) | (b >> 4)
+        slave[j] = ((a & 0x0F) << 4) | (b & 0x0F)
+    return SP6N_MAGIC + len(sp6).to_bytes(4, "little") + master + slave
+
+
+def main() -> int:
+    if len(sys.argv) < 3:
+        print(f"usage: {sys.argv[0]} out_dir file.sp6 [...]", file=sys.stderr)
+        return 2
+    out_dir = Path(sys.argv[1])
+    out_dir.mkdir(parents=True, exist_ok=True)
+
+    lines = []
+    for name in sys.argv[2:]:
+        sp6 = Path(name).read_bytes()
+        stem = Path(name).stem
+        for layout, frame in (("sp6", sp6), ("sp6n", sp6_to_native(sp6))):
+            expected = out_dir / f"{stem}.{layout}"
+            expected.write_bytes(frame)
+            for codec, encode in CODECS.items():
+                body = out_dir / f"{stem}.{layout}.{codec}"
+                body.write_bytes(encode(frame))
+                lines.append(f"{body} {expected}\n")
+    (out_dir / "cases.txt").write_text("".join(lines))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,168 @@
+// Feeds the upload bodies listed by gen_cases.py through main/upload_decoder.c
+// in pieces of 1 byte up to the whole body, into a frame buffer and through a
+// sink as the stream handler does. Every body must decode to its frame, and
+// every truncated codec body (header kept) must fail with "... decode failed".
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epd_169inch.h"
+#include "upload_decoder.h"
+
+// The stream handler's staging window.
+#define TEST_STAGING 512
+#define TEST_FRAME_CAP (EPD_FRAME_BYTES + EPD_SP6N_HEADER_BYTES)
+
+static const size_t s_chunks[] = {1, 2, 3, 7, 64, 512, 1 << 20};
+static const size_t s_cut_chunks[] = {1, 64, 1 << 20};
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} collect_t;
+
+static uint8_t *load_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc((size_t)size) : NULL;
+    if (buf && fread(buf, (size_t)size, 1, f) != 1) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = buf ? (size_t)size : 0;
+    return buf;
+}
+
+static bool collect_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    collect_t *c = ctx;
+    if (len > TEST_FRAME_CAP - c->len) {
+        return false;
+    }
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    return true;
+}
+
+// Decodes body[0..len) in pieces of chunk; the frame ends up in frame.
+static bool decode(const uint8_t *body, size_t len, size_t chunk, bool sink, uint8_t *frame,
+                   size_t *frame_len, const char **error)
+{
+    uint8_t staging[TEST_STAGING];
+    collect_t c = {.buf = frame};
+    upload_decoder_t dec;
+    if (sink) {
+        upload_decoder_init(&dec, staging, sizeof(staging), EPD_FRAME_BYTES, len, collect_sink,
+                            &c);
+    } else {
+        upload_decoder_init(&dec, frame, TEST_FRAME_CAP, EPD_FRAME_BYTES, len, NULL, NULL);
+    }
+
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < len; pos += chunk) {
+        size_t n = len - pos < chunk ? len - pos : chunk;
+        ok = upload_decoder_feed(&dec, body + pos, n);
+    }
+    ok = ok && upload_decoder_finish(&dec);
+    upload_decoder_release(&dec);
+    *frame_len = sink ? c.len : upload_decoded(&dec);
+    *error = dec.error;
+    return ok;
+}
+
+static bool check_case(const char *name, const uint8_t *body, size_t body_len,
+                       const uint8_t *expect, size_t expect_len, uint8_t *frame)
+{
+    bool ok = true;
+    for (int sink = 0; sink <= 1; sink++) {
+        for (size_t i = 0; i < sizeof(s_chunks) / sizeof(s_chunks[0]); i++) {
+            size_t len = 0;
+            const char *error = NULL;
+            if (!decode(body, body_len, s_chunks[i], sink, frame, &len, &error)) {
+                fprintf(stderr, "%s %s in %zu: %s\n", name, sink ? "sink" : "buffer",
+                        s_chunks[i], error ? error : "failed");
+                ok = false;
+            } else if (len != expect_len || memcmp(frame, expect, len) != 0) {
+                fprintf(stderr, "%s %s in %zu: frame differs\n", name, sink ? "sink" : "buffer",
+                        s_chunks[i]);
+                ok = false;
+            }
+        }
+    }
+
+    // A raw body carries no codec header and fails on its length instead.
+    if (memcmp(body, "SP6", 3) != 0 || body[3] == 'N') {
+        return ok;
+    }
+    size_t header = body[3] == 'C' ? 10U : 8U;
+    for (size_t cut = 1; cut < body_len - header; cut *= 7) {
+        for (int sink = 0; sink <= 1; sink++) {
+            for (size_t i = 0; i < sizeof(s_cut_chunks) / sizeof(s_cut_chunks[0]); i++) {
+                size_t len = 0;
+                const char *error = NULL;
+                bool res =
+                    decode(body, body_len - cut, s_cut_chunks[i], sink, frame, &len, &error);
+                if (res || !error || !strstr(error, "decode failed")) {
+                    fprintf(stderr, "%s %s cut %zu in %zu: %s\n", name,
+                            sink ? "sink" : "buffer", cut, s_cut_chunks[i],
+                            res ? "decoded" : (error ? error : "failed without an error"));
+                    ok = false;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s cases.txt\n", argv[0]);
+        return 2;
+    }
+    FILE *list = fopen(argv[1], "r");
+    if (!list) {
+        fprintf(stderr, "%s: cannot read\n", argv[1]);
+        return 2;
+    }
+
+    uint8_t *frame = malloc(TEST_FRAME_CAP);
+    if (!frame) {
+        fclose(list);
+        return 2;
+    }
+    bool ok = true;
+    int cases = 0;
+    char body_path[1024];
+    char expect_path[1024];
+    while (fscanf(list, "%1023s %1023s", body_path, expect_path) == 2) {
+        size_t body_len = 0;
+        size_t expect_len = 0;
+        uint8_t *body = load_file(body_path, &body_len);
+        uint8_t *expect = load_file(expect_path, &expect_len);
+        if (!body || !expect || body_len < 4U) {
+            fprintf(stderr, "%s: cannot read case\n", body_path);
+            ok = false;
+        } else {
+            ok &= check_case(body_path, body, body_len, expect, expect_len, frame);
+            cases++;
+        }
+        free(body);
+        free(expect);
+    }
+    fclose(list);
+    free(frame);
+
+    ok &= cases > 0;
+    printf("%d cases: %s\n", cases, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -1,19 +1,43 @@
 #!/usr/bin/env python3
-"""Upload raw sp6 image bytes to the ESP32 HTTP endpoint."""
+"""Upload raw sp6 (or SP6N container) image bytes to the ESP32 HTTP endpoint.
+
+The bytes can go as they are or wrapped in one of the device's codecs: nibble
+RLE (SP6R and the denser SP6V), heatshrink (HSK1), 3-bit packing (SP6P) or the
+context-modelled range coder (SP6C) that suits dithered photos best. With --delta-cache only
+the tiles that changed since the cached frame go to /image/delta (SP6D).
+"""
 
 from __future__ import annotations
 
 import argparse
+import zlib
 from pathlib import Path
+from urllib.error import HTTPError
 from urllib.request import Request, urlopen
 
 
 RLE_MAGIC = b"SP6R"
+RLE2_MAGIC = b"SP6V"
 HS_MAGIC = b"HSK1"
+PACKED_MAGIC = b"SP6P"
+CONTEXT_MAGIC = b"SP6C"
+SP6N_MAGIC = b"SP6N"
+
+# --window-bits auto searches every setting the device decodes
+# (UPLOAD_HS_MAX_WINDOW_BITS in main/config.h) for the smallest output.
+HS_AUTO_WINDOW_BITS = range(8, 13)
+HS_AUTO_MIN_LOOKAHEAD_BITS = 3
+DELTA_MAGIC = b"SP6D"
 
+# The frame is cut as a byte grid of 200-byte rows; an sp6 tile is 16x16 px.
+DELTA_ROW_BYTES = 200
+DELTA_TILE_W = 8
+DELTA_TILE_ROWS = 16
 
-def encode_heatshrink_wasm(raw: bytes, wasm_path: Path, window_bits: int,
+
+def encode_heatshrink_wasm(raw: bytes, wasm_path: Path, window_bits: int | None,
                            lookahead_bits: int) -> bytes:
+    """Heatshrink-encodes raw; window_bits None picks the smallest setting."""
     try:
         from wasmtime import Instance, Module, Store
     except ImportError as exc:
@@ -40,17 +64,32 @@ def encode_heatshrink_wasm(raw: bytes, wasm_path: Path, window_bits: int,
         raise SystemExit("heatshrink wasm allocation failed")
 
     memory.write(store, raw, in_ptr)
-    out_size = hs_encode(store, in_ptr, len(raw), out_ptr, out_cap,
-                         window_bits, lookahead_bits)
-    if out_size <= 0:
-        hs_free(store, in_ptr)
-        hs_free(store, out_ptr)
-        raise SystemExit("heatshrink wasm encoding failed")
+    if window_bits is not None:
+        settings = [(window_bits, lookahead_bits)]
+    elif "hs_last_params" in exports:
+        # The module searches the grid itself (window bits 0).
+        settings = [(0, 0)]
+    else:
+        settings = [(w, l) for w in HS_AUTO_WINDOW_BITS
+                    for l in range(HS_AUTO_MIN_LOOKAHEAD_BITS, w)]
 
-    payload = memory.read(store, out_ptr, out_ptr + out_size)
+    best = None
+    for w, l in settings:
+        out_size = hs_encode(store, in_ptr, len(raw), out_ptr, out_cap, w, l)
+        if out_size <= 0 or (best is not None and out_size >= len(best[2])):
+            continue
+        if w == 0:
+            params = exports["hs_last_params"](store)
+            w, l = params >> 8, params & 0xFF
+        best = (w, l, memory.read(store, out_ptr, out_ptr + out_size))
     hs_free(store, in_ptr)
     hs_free(store, out_ptr)
+    if best is None:
+        raise SystemExit("heatshrink wasm encoding failed")
 
+    window_bits, lookahead_bits, payload = best
+    if len(settings) > 1 or settings[0][0] == 0:
+        print(f"Heatshrink auto: window {window_bits}, lookahead {lookahead_bits}")
     header = HS_MAGIC + len(raw).to_bytes(4, "little") + bytes([
         window_bits & 0xFF,
         lookahead_bits & 0xFF,
@@ -91,36 +130,265 @@ def rle_encode_sp6_nibbles(raw: bytes) -> bytes:
     return bytes(out)
 
 
+def rle2_encode_sp6_nibbles(raw: bytes) -> bytes:
+    """SP6V: one byte per run, value in the high nibble and length 1..15 in the
+    low one. Length 0 is followed by a LEB128 varint of length - 16."""
+    out = bytearray(RLE2_MAGIC)
+    out.extend(len(raw).to_bytes(4, "little"))
+
+    def emit(value: int, length: int) -> None:
+        if length < 16:
+            out.append((value << 4) | length)
+            return
+        out.append(value << 4)
+        rest = length - 16
+        while rest >= 0x80:
+            out.append((rest & 0x7F) | 0x80)
+            rest >>= 7
+        out.append(rest)
+
+    run_value = raw[0] >> 4 if raw else 0
+    run_length = 0
+    for byte in raw:
+        for nibble in (byte >> 4, byte & 0x0F):
+            if nibble == run_value:
+                run_length += 1
+            else:
+                emit(run_value, run_length)
+                run_value = nibble
+                run_length = 1
+    if run_length:
+        emit(run_value, run_length)
+    return bytes(out)
+
+
+def pack_sp6p(raw: bytes) -> bytes:
+    """Pack every pixel into 3 bits: 8 pixels per 3 bytes, MSB first.
+
+    An SP6N container keeps its header out of the packed stream; the size field
+    tells the device to put it back (80008 instead of 80000).
+    """
+    pixels = raw[8:] if raw.startswith(SP6N_MAGIC) else raw
+    if len(pixels) % 4 != 0:
+        raise SystemExit("packed frames must hold a multiple of 8 pixels")
+
+    out = bytearray(PACKED_MAGIC)
+    out.extend(len(raw).to_bytes(4, "little"))
+    for i in range(0, len(pixels), 4):
+        word = 0
+        for byte in pixels[i:i + 4]:
+            hi, lo = byte >> 4, byte & 0x0F
+            if hi > 7 or lo > 7:
+                raise SystemExit(f"pixel code out of range at byte {i}")
+            word = (word << 6) | (hi << 3) | lo
+        out.extend(word.to_bytes(3, "big"))
+    return bytes(out)
+
+
+def split_frame(raw: bytes) -> tuple[int, bytes]:
+    """Return (frame format, frame bytes) the way the device stores them."""
+    if raw.startswith(SP6N_MAGIC):
+        return 1, raw[8:]
+    return 0, raw
+
+
+def delta_sp6d(base: bytes, raw: bytes) -> bytes | None:
+    """Encode the tiles of raw that differ from base, or None if not possible."""
+    base_format, base_frame = split_frame(base)
+    fmt, frame = split_frame(raw)
+    if fmt != base_format or len(frame) != len(base_frame) or len(frame) % DELTA_ROW_BYTES:
+        return None
+
+    tiles_x = DELTA_ROW_BYTES // DELTA_TILE_W
+    tiles_y = len(frame) // DELTA_ROW_BYTES // DELTA_TILE_ROWS
+    records = bytearray()
+    count = 0
+    for index in range(tiles_x * tiles_y):
+        row = (index // tiles_x) * DELTA_TILE_ROWS
+        col = (index % tiles_x) * DELTA_TILE_W
+        tile = b"".join(frame[(row + r) * DELTA_ROW_BYTES + col:
+                              (row + r) * DELTA_ROW_BYTES + col + DELTA_TILE_W]
+                        for r in range(DELTA_TILE_ROWS))
+        old = b"".join(base_frame[(row + r) * DELTA_ROW_BYTES + col:
+                                  (row + r) * DELTA_ROW_BYTES + col + DELTA_TILE_W]
+                       for r in range(DELTA_TILE_ROWS))
+        if tile != old:
+            records.extend(index.to_bytes(2, "little"))
+            records.extend(tile)
+            count += 1
+
+    out = bytearray(DELTA_MAGIC)
+    out.extend(zlib.crc32(base_frame).to_bytes(4, "little"))
+    out.extend(bytes([fmt, DELTA_TILE_W, DELTA_TILE_ROWS, 0]))
+    out.extend(count.to_bytes(2, "little"))
+    out.extend(records)
+    return bytes(out)
+
+
+def post(url: str, data: bytes) -> str:
+    req = Request(url, data=data, method="POST")
+    req.add_header("Content-Type", "application/octet-stream")
+    req.add_header("Content-Length", str(len(data)))
+    with urlopen(req, timeout=30) as resp:
+        return resp.read().decode("utf-8", errors="ignore")
+
+
+class RangeEncoder:
+    """Binary range coder with 11-bit adaptive probabilities (LZMA style)."""
+
+    PROB_BITS = 11
+    MOVE_BITS = 4
+
+    def __init__(self) -> None:
+        self.low = 0
+        self.range = 0xFFFFFFFF
+        self.cache = 0
+        self.cache_size = 1
+        self.out = bytearray()
+
+    def _shift_low(self) -> None:
+        if self.low < 0xFF000000 or self.low >= 1 << 32:
+            carry = self.low >> 32
+            temp = self.cache
+            while True:
+                self.out.append((temp + carry) & 0xFF)
+                temp = 0xFF
+                self.cache_size -= 1
+                if self.cache_size == 0:
+                    break
+            self.cache = (self.low >> 24) & 0xFF
+        self.cache_size += 1
+        self.low = (self.low & 0x00FFFFFF) << 8
+
+    def encode(self, probs: list[int], index: int, bit: int) -> None:
+        prob = probs[index]
+        bound = (self.range >> self.PROB_BITS) * prob
+        if bit == 0:
+            self.range = bound
+            probs[index] = prob + (((1 << self.PROB_BITS) - prob) >> self.MOVE_BITS)
+        else:
+            self.low += bound
+            self.range -= bound
+            probs[index] = prob - (prob >> self.MOVE_BITS)
+        while self.range < 1 << 24:
+            self.range = (self.range << 8) & 0xFFFFFFFF
+            self._shift_low()
+
+    def finish(self) -> bytes:
+        for _ in range(5):
+            self._shift_low()
+        return bytes(self.out)
+
+
+def encode_sp6c(raw: bytes) -> bytes:
+    """SP6C: every 3-bit pixel range coded MSB first down a 7-node tree whose
+    probabilities depend on the left, upper and upper-left pixels.
+
+    SP6N planes hold every other pixel of a line, so their stride is half a
+    line; like SP6P the container header is left out and restored on the
+    device from the size field.
+    """
+    native = raw.startswith(SP6N_MAGIC)
+    pixels_bytes = raw[8:] if native else raw
+    stride = 200 if native else 400
+
+    pixels = bytearray(len(pixels_bytes) * 2)
+    pixels[0::2] = bytes(b >> 4 for b in pixels_bytes)
+    pixels[1::2] = bytes(b & 0x0F for b in pixels_bytes)
+    if max(pixels, default=0) > 7:
+        raise SystemExit("SP6C needs pixel codes 0..7")
+
+    probs = [1 << (RangeEncoder.PROB_BITS - 1)] * (512 * 7)
+    enc = RangeEncoder()
+    for i, value in enumerate(pixels):
+        left = pixels[i - 1] if i >= 1 else 0
+        up = pixels[i - stride] if i >= stride else 0
+        up_left = pixels[i - stride - 1] if i >= stride + 1 else 0
+        base = ((left << 6) | (up << 3) | up_left) * 7
+        node = 1
+        for shift in (2, 1, 0):
+            bit = (value >> shift) & 1
+            enc.encode(probs, base + node - 1, bit)
+            node = (node << 1) | bit
+
+    out = bytearray(CONTEXT_MAGIC)
+    out.extend(len(raw).to_bytes(4, "little"))
+    out.extend(stride.to_bytes(2, "little"))
+    out.extend(enc.finish())
+    return bytes(out)
+
+
 def main() -> int:
     parser = argparse.ArgumentParser()
-    parser.add_argument("raw", help="Raw sp6 file to upload")
+    parser.add_argument("raw", help="Raw sp6 or sp6n file to upload")
     parser.add_argument("--url", default="http://espressif.lan/image", help="POST target URL")
     parser.add_argument("--rle", action="store_true", help="Upload with nibble RLE")
+    parser.add_argument("--rle2", action="store_true",
+                        help="Upload with SP6V nibble RLE (one byte per short run)")
+    parser.add_argument("--pack3", action="store_true",
+                        help="Upload as SP6P, 3 bits per pixel (75%% of raw)")
     parser.add_argument("--heatshrink-wasm", action="store_true",
                         help="Upload with heatshrink (WASM encoder)")
+    parser.add_argument("--sp6c", action="store_true",
+                        help="Upload as SP6C, the context-modelled coder for dithered photos")
     parser.add_argument("--wasm", default="",
                         help="Path to heatshrink.wasm for encoding")
-    parser.add_argument("--window-bits", type=int, default=10,
-                        help="Heatshrink window bits")
+    parser.add_argument("--window-bits", default="10",
+                        help="Heatshrink window bits, or 'auto' to pick the window and "
+                             "lookahead that give the smallest upload")
     parser.add_argument("--lookahead-bits", type=int, default=4,
                         help="Heatshrink lookahead bits")
+    parser.add_argument("--stream", action="store_true",
+                        help="POST to /image/stream (sp6n only); the panel refreshes as data arrives")
+    parser.add_argument("--delta-cache", default="",
+                        help="File holding the last uploaded frame; send only changed tiles "
+                             "against it and update it after each upload")
     args = parser.parse_args()
 
     data = Path(args.raw).read_bytes()
+    raw = data
+    cache = Path(args.delta_cache) if args.delta_cache else None
+    url = args.url
+    if args.stream:
+        if not data.startswith(b"SP6N"):
+            raise SystemExit("--stream needs an sp6n file")
+        url = url.rstrip("/") + "/stream"
     if args.heatshrink_wasm:
         wasm_path = Path(args.wasm) if args.wasm else Path(__file__).with_name("heatshrink.wasm")
         if not wasm_path.exists():
             raise SystemExit(f"WASM not found: {wasm_path}")
-        data = encode_heatshrink_wasm(data, wasm_path, args.window_bits, args.lookahead_bits)
+        window_bits = None if args.window_bits == "auto" else int(args.window_bits)
+        data = encode_heatshrink_wasm(data, wasm_path, window_bits, args.lookahead_bits)
+    elif args.sp6c:
+        data = encode_sp6c(data)
+    elif args.rle2:
+        data = rle2_encode_sp6_nibbles(data)
     elif args.rle:
         data = rle_encode_sp6_nibbles(data)
-    req = Request(args.url, data=data, method="POST")
-    req.add_header("Content-Type", "application/octet-stream")
-    req.add_header("Content-Length", str(len(data)))
+    elif args.pack3:
+        data = pack_sp6p(data)
 
-    with urlopen(req, timeout=30) as resp:
-        body = resp.read().decode("utf-8", errors="ignore")
-        print(body)
+    delta = None
+    if cache and cache.exists() and not args.stream:
+        delta = delta_sp6d(cache.read_bytes(), raw)
+    sent = False
+    if delta is not None and len(delta) < len(data):
+        try:
+            print(post(url.rstrip("/") + "/delta", delta))
+            print(f"Sent {len(delta)} byte delta instead of {len(data)} bytes")
+            sent = True
+        except HTTPError as err:
+            if err.code != 409:
+                raise
+            print("Device holds a different base frame, sending the full image")
+    if not sent:
+        print(post(url, data))
+
+    # A streamed frame is never stored on the device, so it cannot be a base.
+    if cache and args.stream:
+        cache.unlink(missing_ok=True)
+    elif cache:
+        cache.write_bytes(raw)
 
     return 0
 